@@ -0,0 +1,47 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include<vector>
+#include<chrono>
+#include<random>
+#include"curve_point.h"
+
+using namespace std;
+
+namespace bench {
+
+// Mean time of f() in milliseconds, repeated until `min_ms` have elapsed
+// and at least `min_runs` times, after one warm-up call
+template<typename F>
+double mean_ms(F &&f, size_t min_runs = 3, double min_ms = 200.0)
+{
+    f();
+    size_t runs = 0;
+    const auto t1 = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    while(runs < min_runs || elapsed < min_ms)
+    {
+        f();
+        runs++;
+        elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t1).count();
+    }
+    return elapsed / double(runs);
+}
+
+// n knots over [0, 1] in x, random y and curve factors, sorted by x
+inline vector<curve_point> random_curve(size_t n, unsigned seed = 1)
+{
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    vector<curve_point> knots(n);
+    for(size_t i = 0; i < n; i++)
+    {
+        const float x = (n > 1) ? float(i) / float(n - 1) : 0.0f;
+        knots[i] = curve_point(x, unit(gen), unit(gen) * 4.0f - 2.0f);
+    }
+    return knots;
+}
+
+}
+
+#endif // BENCH_H
@@ -0,0 +1,71 @@
+/*=============================================================================
+   Copyright (c) 2021 Johann Philippe
+
+   Distributed under the MIT License (https://opensource.org/licenses/MIT)
+=============================================================================*/
+// Batch evaluation throughput of 64 curves of 1000 knots, in queries per
+// second, against a naive baseline evaluating one point per call with a
+// fresh binary search. Times are evenly spaced, then random sorted.
+#include<iostream>
+#include<stdio.h>
+#include"curve_json.h"
+#include"curve_batch.h"
+#include"bench.h"
+
+int main()
+{
+    const size_t n_curves = 64, n_knots = 1000, n_times = 1 << 14;
+    curves::task_pool pool;
+
+    vector<float> even(n_times), scattered(n_times);
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    for(size_t i = 0; i < n_times; i++)
+    {
+        even[i] = float(i) / float(n_times - 1);
+        scattered[i] = unit(gen);
+    }
+    std::sort(scattered.begin(), scattered.end());
+    vector<float> out(n_curves * n_times);
+
+    printf("%zu curves of %zu knots, %zu times, %zu threads, M queries/s\n",
+           n_curves, n_knots, n_times, pool.threads());
+    printf("%18s %10s %10s %10s %10s %10s\n", "mode", "times", "naive", "batch", "pool", "pool/naive");
+    for(int m = 0; m < curve_mode_count; m++)
+    {
+        const curve_mode mode = curve_mode(m);
+        vector<curves::curve_evaluator<float>> evaluators(n_curves);
+        for(size_t c = 0; c < n_curves; c++)
+            evaluators[c].prepare(bench::random_curve(n_knots, unsigned(c + 1)), mode);
+
+        for(const vector<float> *times : {&even, &scattered})
+        {
+            const float *t = times->data();
+            const double naive = bench::mean_ms([&]() {
+                for(size_t c = 0; c < n_curves; c++)
+                    for(size_t j = 0; j < n_times; j++)
+                    {
+                        evaluators[c].rewind();
+                        evaluators[c].evaluate(t + j, 1, out.data() + c * n_times + j);
+                    }
+            });
+            const double batch = bench::mean_ms([&]() {
+                for(size_t c = 0; c < n_curves; c++)
+                {
+                    evaluators[c].rewind();
+                    evaluators[c].evaluate(t, n_times, out.data() + c * n_times);
+                }
+            });
+            const double pooled = bench::mean_ms([&]() {
+                for(auto &e : evaluators) e.rewind();
+                curves::evaluate_batch(evaluators, t, n_times, out.data(), pool);
+            });
+            const double queries = double(n_curves * n_times);
+            printf("%18s %10s %10.1f %10.1f %10.1f %10.1f\n", curves::mode_name(mode),
+                   (times == &even) ? "even" : "random",
+                   queries / (naive * 1000.0), queries / (batch * 1000.0),
+                   queries / (pooled * 1000.0), naive / pooled);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,98 @@
+/*=============================================================================
+   Copyright (c) 2021 Johann Philippe
+
+   Distributed under the MIT License (https://opensource.org/licenses/MIT)
+=============================================================================*/
+// Load times of the binary curve library against its JSON export.
+// usage : curve_library_bench [curves] [knots per curve] [directory]
+// Files are written to the directory (the current one by default) and removed
+// at the end. Times are measured with the files in the page cache.
+// The JSON reader holds the whole text in memory, so the JSON side is skipped
+// above json_max_knots : 10000 curves of 8192 knots make a 1 GB library.
+#include<iostream>
+#include<fstream>
+#include<string>
+#include<stdio.h>
+#include<stdlib.h>
+#include"curve_library.h"
+#include"curve_json.h"
+#include"bench.h"
+
+constexpr static const size_t json_max_knots = size_t(1) << 24;
+
+static size_t file_size(const string &path)
+{
+    ifstream is(path, ios::binary | ios::ate);
+    return is ? size_t(is.tellg()) : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const size_t n_curves = (argc > 1) ? size_t(atol(argv[1])) : 200;
+    const size_t n_knots = (argc > 2) ? size_t(atol(argv[2])) : 8192;
+    const string dir = (argc > 3) ? string(argv[3]) + "/" : string();
+    const string binary_path = dir + "curve_library_bench.crvl";
+    const string json_path = dir + "curve_library_bench.json";
+    const bool with_json = n_curves * n_knots <= json_max_knots;
+    if(n_curves == 0 || n_knots == 0) return 1;
+
+    // curves are streamed to the library, and kept only for the JSON export
+    vector<curves::curve_entry> entries;
+    curves::curve_library_writer writer;
+    if(!writer.open(binary_path)) {
+        cerr << "could not write " << binary_path << endl;
+        return 1;
+    }
+    for(size_t i = 0; i < n_curves; i++)
+    {
+        curves::curve_entry e;
+        e.name = "curve " + std::to_string(i);
+        e.mode = curve_mode(i % curve_mode_count);
+        e.knots = bench::random_curve(n_knots, unsigned(i + 1));
+        writer.add(e.name, e.mode, e.knots);
+        if(with_json) entries.push_back(std::move(e));
+    }
+    if(!writer.close()) return 1;
+    if(with_json) {
+        ofstream os(json_path);
+        curves::write_json(os, entries);
+        entries.clear();
+    }
+    printf("%zu curves of %zu knots : binary %.1f MB", n_curves, n_knots, double(file_size(binary_path)) / 1e6);
+    if(with_json) printf(", JSON %.1f MB", double(file_size(json_path)) / 1e6);
+    printf("\n");
+
+    vector<curve_point> knots;
+    const double open_ms = bench::mean_ms([&]() {
+        curves::curve_library library;
+        library.open(binary_path);
+    });
+
+    curves::curve_library library;
+    library.open(binary_path);
+    std::mt19937 gen(3);
+    const double one_ms = bench::mean_ms([&]() { library.load(gen() % library.size(), knots); }, 100);
+    const double all_ms = bench::mean_ms([&]() {
+        curves::curve_library lib;
+        lib.open(binary_path);
+        for(size_t i = 0; i < lib.size(); i++) lib.load(i, knots);
+    }, 1);
+    printf("binary : open %.3f ms, load one curve %.3f ms, open and load all %.2f ms\n",
+           open_ms, one_ms, all_ms);
+
+    if(with_json) {
+        vector<curves::curve_entry> parsed;
+        const double json_ms = bench::mean_ms([&]() {
+            ifstream is(json_path);
+            curves::read_json(is, parsed);
+        }, 1);
+        if(parsed.size() != n_curves) cerr << "JSON read failed" << endl;
+        printf("JSON   : read all %.2f ms (%.0fx the binary)\n", json_ms, json_ms / all_ms);
+    } else {
+        printf("JSON   : skipped above %zu knots\n", json_max_knots);
+    }
+
+    ::remove(binary_path.c_str());
+    ::remove(json_path.c_str());
+    return 0;
+}
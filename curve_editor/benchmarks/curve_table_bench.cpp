@@ -0,0 +1,49 @@
+/*=============================================================================
+   Copyright (c) 2021 Johann Philippe
+
+   Distributed under the MIT License (https://opensource.org/licenses/MIT)
+=============================================================================*/
+// Lookup table rendering time of every curve mode, and envelope player
+// throughput reading the rendered table in audio sized blocks.
+#include<iostream>
+#include<stdio.h>
+#include"curve_json.h"
+#include"curve_table.h"
+#include"envelope_player.h"
+#include"bench.h"
+
+int main()
+{
+    const size_t n_knots = 1000, table_size = 1 << 16;
+    const vector<curve_point> knots = bench::random_curve(n_knots);
+    vector<float> table(table_size);
+    curves::curve_table<float> renderer;
+
+    printf("rendering %zu knots into %zu entries\n", n_knots, table_size);
+    printf("%18s %12s\n", "mode", "ms");
+    for(int m = 0; m < curve_mode_count; m++)
+    {
+        const curve_mode mode = curve_mode(m);
+        const double ms = bench::mean_ms([&]() { renderer.render(knots, mode, table.data(), table.size()); });
+        printf("%18s %12.3f\n", curves::mode_name(mode), ms);
+    }
+
+    renderer.render(knots, curve_mode::cubic_spline, table.data(), table.size());
+    const size_t block = 64, blocks = 1 << 14;
+    vector<float> out(block);
+    curves::envelope_player<float> player(table.data(), table.size());
+    // keeps the output alive
+    volatile float sink = 0;
+    const double ms = bench::mean_ms([&]() {
+        // the whole table, played over all the blocks
+        player.start(double(block * blocks), 1.0);
+        for(size_t b = 0; b < blocks; b++)
+        {
+            player.process(out.data(), block);
+            sink = out[block - 1];
+        }
+    });
+    printf("\nplayback : %.1f M samples/s (blocks of %zu)\n",
+           double(block * blocks) / (ms * 1000.0), block);
+    return 0;
+}
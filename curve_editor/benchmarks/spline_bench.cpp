@@ -0,0 +1,39 @@
+/*=============================================================================
+   Copyright (c) 2021 Johann Philippe
+
+   Distributed under the MIT License (https://opensource.org/licenses/MIT)
+=============================================================================*/
+// Natural spline rebuild time from 10 to 1M knots : the Thomas solve alone
+// (build), the solve plus 2048 output points (interpolate_from_points), and
+// the incremental update of one moved knot.
+#include<iostream>
+#include<stdio.h>
+#include"spline.h"
+#include"bench.h"
+
+int main()
+{
+    const int precision = 2048;
+    printf("%10s %14s %18s %14s\n", "knots", "build (ms)", "build+2048 (ms)", "update (us)");
+    for(size_t n : {size_t(10), size_t(100), size_t(1000), size_t(10000), size_t(100000), size_t(1000000)})
+    {
+        vector<curve_point> knots = bench::random_curve(n);
+        curves::cubic_spline<float> spline;
+        point size(1.0f, 1.0f);
+
+        const double build = bench::mean_ms([&]() { spline.build(knots); });
+        const double full = bench::mean_ms([&]() { spline.interpolate_from_points(knots, precision, size); });
+
+        std::mt19937 gen(2);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        spline.build(knots);
+        const double update = bench::mean_ms([&]() {
+            const int k = int(gen() % n);
+            knots[k].y = unit(gen);
+            spline.update_coefficients(knots, k);
+        }, 100);
+
+        printf("%10zu %14.4f %18.4f %14.2f\n", n, build, full, update * 1000.0);
+    }
+    return 0;
+}
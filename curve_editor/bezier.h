@@ -0,0 +1,211 @@
+#ifndef BEZIER_H
+#define BEZIER_H
+
+#include<vector>
+#include<algorithm>
+#include<math.h>
+#include"curve_point.h"
+
+namespace curves {
+
+// Bezier curve evaluated as y(x).
+// Knots sorted by x give control points sorted by x, so x(t) is monotonic on
+// every segment and x(t) = x has a single solution. Each segment keeps x at
+// lut_size evenly spaced t : a binary search in that table brackets the
+// solution and seeds a Newton iteration, which falls back to bisection when
+// a step leaves the bracket. Segments are stored in power form, quadratic
+// ones with a zero cubic term, for Horner evaluation and forward differencing.
+template<typename T>
+class bezier_curve
+{
+public:
+
+    constexpr static const size_t lut_size = 32;
+    constexpr static const int max_iterations = 24;
+
+    // Segments of `degree` (2 or 3) knots after the first, trailing knots ignored
+    template<typename Points>
+    void build(const Points &p, size_t degree)
+    {
+        segs.clear();
+        if(p.size() < degree + 1) return;
+        const size_t n_segments = (p.size() - 1) / degree;
+        segs.resize(n_segments);
+        for(size_t s = 0; s < n_segments; s++)
+        {
+            double px[4], py[4];
+            for(size_t k = 0; k <= degree; k++)
+            {
+                px[k] = p[s * degree + k].x;
+                py[k] = p[s * degree + k].y;
+            }
+            segment &sg = segs[s];
+            power_form(px, degree, sg.x);
+            power_form(py, degree, sg.y);
+            sg.x_begin = px[0];
+            sg.x_end = px[degree];
+            for(size_t k = 0; k < lut_size; k++)
+                sg.lut[k] = horner(sg.x, double(k) / double(lut_size - 1));
+        }
+    }
+
+    size_t segments() const {return segs.size();}
+    bool empty() const {return segs.empty();}
+    T first_x() const {return T(segs.front().x_begin);}
+    T last_x() const {return T(segs.back().x_end);}
+    T first_y() const {return T(segs.front().y[3]);}
+    T last_y() const {return T(horner(segs.back().y, 1.0));}
+    T segment_begin(size_t i) const {return T(segs[i].x_begin);}
+    T segment_end(size_t i) const {return T(segs[i].x_end);}
+
+    // Value at x in segment i. With a hint, the previous solution seeds the
+    // iteration when it lies in the bracket, and receives the new one.
+    T segment_y(size_t i, T x, double *hint = nullptr) const
+    {
+        const segment &sg = segs[i];
+        const double xv = double(x);
+        const size_t k = size_t(std::upper_bound(sg.lut, sg.lut + lut_size, xv) - sg.lut);
+        const size_t hi_k = std::min(std::max(k, size_t(1)), lut_size - 1);
+        double lo = double(hi_k - 1) / double(lut_size - 1), hi = double(hi_k) / double(lut_size - 1);
+        double t;
+        if(hint != nullptr && *hint >= lo && *hint <= hi) {
+            t = *hint;
+        } else {
+            const double x_lo = sg.lut[hi_k - 1], x_hi = sg.lut[hi_k];
+            t = (x_hi > x_lo) ? lo + (hi - lo) * (xv - x_lo) / (x_hi - x_lo) : lo;
+        }
+        t = solve(sg, xv, t, lo, hi);
+        if(hint != nullptr) *hint = t;
+        return T(horner(sg.y, t));
+    }
+
+    // Value at x, the end values being held outside of the curve
+    T value(T x) const
+    {
+        if(segs.empty()) return T(0);
+        if(x <= first_x()) return first_y();
+        if(x >= last_x()) return last_y();
+        size_t lo = 0, hi = segs.size();
+        while(hi - lo > 1)
+        {
+            const size_t mid = (lo + hi) / 2;
+            if(segs[mid].x_begin <= double(x)) lo = mid;
+            else hi = mid;
+        }
+        return segment_y(lo, x);
+    }
+
+    // Writes the values at x = x0 + j * dx for j in [0, n), dx > 0.
+    // Each segment is walked with forward differences on a t grid four times
+    // finer than its outputs; every output gets its t interpolated between the
+    // two grid points around it, then one Newton step.
+    void render(T x0, T dx, size_t n, T *out) const
+    {
+        if(segs.empty()) {
+            std::fill(out, out + n, T(0));
+            return;
+        }
+        auto xj = [&](size_t j) {return double(x0) + double(j) * double(dx);};
+        size_t j = 0;
+        for(; j < n && xj(j) < segs.front().x_begin; j++)
+            out[j] = first_y();
+        for(size_t s = 0; s < segs.size() && j < n; s++)
+        {
+            const segment &sg = segs[s];
+            const bool last = (s + 1 == segs.size());
+            size_t end = j;
+            while(end < n && (xj(end) < sg.x_end || (last && xj(end) <= sg.x_end)))
+                end++;
+            if(end == j) continue;
+
+            const size_t steps = (end - j) * 4 + 16;
+            const double h = 1.0 / double(steps);
+            const double *c = sg.x;
+            double f = c[3];
+            double df = c[0] * h * h * h + c[1] * h * h + c[2] * h;
+            double d2f = 6.0 * c[0] * h * h * h + 2.0 * c[1] * h * h;
+            const double d3f = 6.0 * c[0] * h * h * h;
+            double tk = 0.0, xk = f;
+            double xk1 = f + df;
+            size_t k = 0;
+            for(; j < end; j++)
+            {
+                const double xv = xj(j);
+                while(xk1 < xv && k + 1 < steps)
+                {
+                    f += df;
+                    df += d2f;
+                    d2f += d3f;
+                    k++;
+                    tk = double(k) * h;
+                    xk = f;
+                    xk1 = f + df;
+                }
+                double t = (xk1 > xk) ? tk + h * (xv - xk) / (xk1 - xk) : tk;
+                t = std::clamp(t, tk, std::min(1.0, tk + h));
+                const double slope = derivative(sg.x, t);
+                if(slope > 0) t = std::clamp(t - (horner(sg.x, t) - xv) / slope, tk, std::min(1.0, tk + h));
+                out[j] = T(horner(sg.y, t));
+            }
+        }
+        for(; j < n; j++)
+            out[j] = last_y();
+    }
+
+private:
+
+    struct segment
+    {
+        // power form a t^3 + b t^2 + c t + d, as {a, b, c, d}
+        double x[4], y[4];
+        double x_begin, x_end;
+        double lut[lut_size];
+    };
+
+    static void power_form(const double *p, size_t degree, double *c)
+    {
+        if(degree == 3) {
+            c[0] = -p[0] + 3.0 * p[1] - 3.0 * p[2] + p[3];
+            c[1] = 3.0 * p[0] - 6.0 * p[1] + 3.0 * p[2];
+            c[2] = 3.0 * (p[1] - p[0]);
+        } else {
+            c[0] = 0.0;
+            c[1] = p[0] - 2.0 * p[1] + p[2];
+            c[2] = 2.0 * (p[1] - p[0]);
+        }
+        c[3] = p[0];
+    }
+
+    static double horner(const double *c, double t)
+    {
+        return ((c[0] * t + c[1]) * t + c[2]) * t + c[3];
+    }
+
+    static double derivative(const double *c, double t)
+    {
+        return (3.0 * c[0] * t + 2.0 * c[1]) * t + c[2];
+    }
+
+    static double solve(const segment &sg, double xv, double t, double lo, double hi)
+    {
+        for(int iter = 0; iter < max_iterations; iter++)
+        {
+            const double err = horner(sg.x, t) - xv;
+            if(std::abs(err) < 1e-9) break;
+            if(err > 0) hi = t;
+            else lo = t;
+            const double slope = derivative(sg.x, t);
+            double next = (slope != 0.0) ? t - err / slope : lo - 1.0;
+            if(next <= lo || next >= hi) next = (lo + hi) / 2.0;
+            if(hi - lo < 1e-12) break;
+            t = next;
+        }
+        return t;
+    }
+
+    std::vector<segment> segs;
+};
+
+}
+
+#endif // BEZIER_H
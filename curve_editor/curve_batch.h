@@ -0,0 +1,269 @@
+#ifndef CURVE_BATCH_H
+#define CURVE_BATCH_H
+
+#include<vector>
+#include<functional>
+#include<algorithm>
+#include<limits>
+#include<math.h>
+#include<cmath>
+#include"curve_point.h"
+#include"log_exp.h"
+#include"spline.h"
+#include"bezier.h"
+#include"local_spline.h"
+#include"task_pool.h"
+
+namespace curves {
+
+// One curve prepared for evaluation at arbitrary x, without any drawing.
+// Values are 1 - y like curve_table, and the end values are held outside
+// of the knots. A cursor keeps the segment of the last query : increasing
+// queries walk it forward in amortized O(1), and the queries falling in one
+// segment are evaluated in a single loop the compiler can vectorize.
+template<typename T>
+class curve_evaluator
+{
+public:
+
+    template<typename Points>
+    void prepare(const Points &p, curve_mode m)
+    {
+        xs.clear();
+        ca.clear(); cb.clear(); cc.clear(); cd.clear();
+        exps.clear();
+        rewind();
+        if(p.empty()) {
+            y_first = y_last = T(1);
+            return;
+        }
+        y_first = p.front().y;
+        y_last = p.back().y;
+        if(p.size() < 2) {
+            xs.push_back(p.front().x);
+            return;
+        }
+        degree = (m == curve_mode::cubic_bezier) ? 3 : 2;
+        if((m == curve_mode::cubic_spline && p.size() < 3) ||
+                ((m == curve_mode::cubic_bezier || m == curve_mode::quadratic_bezier) && p.size() < degree + 1))
+            m = curve_mode::linear;
+        kind = (m == curve_mode::log_exp) ? exponential :
+               (m == curve_mode::cubic_bezier || m == curve_mode::quadratic_bezier) ? bezier : polynomial;
+
+        switch(m)
+        {
+        case curve_mode::cubic_spline:
+        {
+            spline.build(p);
+            for(int i = 0; i < spline.segments(); i++)
+            {
+                T a, b, c, d;
+                spline.coefficients(i, a, b, c, d);
+                push_polynomial(spline.knot_x(i), a, b, c, d);
+            }
+            xs.push_back(spline.knot_x(spline.segments()));
+            break;
+        }
+        case curve_mode::monotone_cubic:
+        case curve_mode::akima:
+        case curve_mode::catmull_rom:
+        {
+            local.build(p, m);
+            for(int i = 0; i < local.segments(); i++)
+            {
+                T a, b, c, d;
+                local.coefficients(i, a, b, c, d);
+                push_polynomial(local.knot_x(i), a, b, c, d);
+            }
+            xs.push_back(local.knot_x(local.segments()));
+            break;
+        }
+        case curve_mode::cubic_bezier:
+        case curve_mode::quadratic_bezier:
+        {
+            bez.build(p, degree);
+            for(size_t i = 0; i < bez.segments(); i++)
+                xs.push_back(bez.segment_begin(i));
+            xs.push_back(bez.last_x());
+            y_last = bez.last_y();
+            break;
+        }
+        default:
+        {
+            auto it = p.begin();
+            curve_point prev = *it;
+            for(++it; it != p.end(); ++it)
+            {
+                const curve_point &next = *it;
+                const T dx = T(next.x) - T(prev.x);
+                if(kind == exponential) {
+                    const float curve = (prev.y > next.y) ? -prev.curve : prev.curve;
+                    xs.push_back(prev.x);
+                    exps.push_back(exp_segment{log_exp_segment<T>(prev.y, next.y, 2, curve),
+                                               (dx > 0) ? T(1) / dx : T(0)});
+                } else {
+                    push_polynomial(prev.x, 0, 0, (dx > 0) ? (T(next.y) - T(prev.y)) / dx : T(0), prev.y);
+                }
+                prev = next;
+            }
+            xs.push_back(prev.x);
+            break;
+        }
+        }
+    }
+
+    // Forgets the cursor, for a new pass over the curve
+    void rewind()
+    {
+        segment = 0;
+        bezier_t = 0;
+    }
+
+    void evaluate(const T *t, size_t n, T *out)
+    {
+        const size_t n_segments = xs.empty() ? 0 : xs.size() - 1;
+        size_t j = 0;
+        while(j < n)
+        {
+            if(n_segments == 0 || t[j] < xs.front()) {
+                out[j++] = T(1) - y_first;
+                continue;
+            }
+            if(t[j] >= xs.back()) {
+                out[j++] = T(1) - y_last;
+                continue;
+            }
+            seek(t[j], n_segments);
+            const T end = xs[segment + 1];
+            size_t run = j + 1;
+            while(run < n && t[run] < end && t[run] >= xs[segment]) run++;
+            evaluate_run(t, j, run, out);
+            j = run;
+        }
+    }
+
+private:
+
+    enum segment_kind {polynomial, exponential, bezier};
+
+    struct exp_segment
+    {
+        log_exp_segment<T> shape;
+        T inv_dx;
+    };
+
+    void push_polynomial(T x0, T a, T b, T c, T d)
+    {
+        xs.push_back(x0);
+        ca.push_back(a);
+        cb.push_back(b);
+        cc.push_back(c);
+        cd.push_back(d);
+    }
+
+    // Moves the cursor to the segment holding x, xs.front() <= x < xs.back()
+    void seek(T x, size_t n_segments)
+    {
+        if(x < xs[segment]) {
+            segment = size_t(std::upper_bound(xs.begin(), xs.begin() + n_segments, x) - xs.begin()) - 1;
+            bezier_t = 0;
+            return;
+        }
+        for(int step = 0; step < 4; step++)
+        {
+            if(x < xs[segment + 1]) return;
+            segment++;
+            bezier_t = 0;
+        }
+        if(x >= xs[segment + 1])
+            segment = size_t(std::upper_bound(xs.begin() + segment, xs.begin() + n_segments, x) - xs.begin()) - 1;
+    }
+
+    // True when t[0] .. t[n - 1] lie on a regular grid, up to rounding
+    static bool evenly_spaced(const T *t, size_t n)
+    {
+        const T dt = (t[n - 1] - t[0]) / T(n - 1);
+        const T tolerance = T(16) * std::numeric_limits<T>::epsilon() * (std::abs(t[0]) + std::abs(t[n - 1]));
+        for(size_t j = 1; j < n - 1; j++)
+            if(std::abs(t[j] - (t[0] + T(j) * dt)) > tolerance) return false;
+        return true;
+    }
+
+    void evaluate_run(const T *t, size_t first, size_t last, T *out)
+    {
+        const size_t i = segment;
+        const T x0 = xs[i];
+        switch(kind)
+        {
+        case polynomial:
+        {
+            const T a = ca[i], b = cb[i], c = cc[i], d = cd[i];
+            for(size_t j = first; j < last; j++)
+            {
+                const T u = t[j] - x0;
+                out[j] = T(1) - (((a * u + b) * u + c) * u + d);
+            }
+            break;
+        }
+        case exponential:
+        {
+            // Evenly spaced times go through the geometric recurrence of
+            // render_at(). Other times still pay one exp() per query, which
+            // the compiler does not vectorize.
+            const exp_segment &e = exps[i];
+            const size_t n = last - first;
+            if(n > 2 && evenly_spaced(t + first, n)) {
+                const T dt = (t[last - 1] - t[first]) / T(n - 1);
+                e.shape.render_at(out + first, int(n), double(t[first] - x0) * e.inv_dx, double(dt) * e.inv_dx);
+                for(size_t j = first; j < last; j++)
+                    out[j] = T(1) - out[j];
+                break;
+            }
+            for(size_t j = first; j < last; j++)
+                out[j] = T(1) - e.shape.at((t[j] - x0) * e.inv_dx);
+            break;
+        }
+        case bezier:
+        {
+            for(size_t j = first; j < last; j++)
+                out[j] = T(1) - bez.segment_y(i, t[j], &bezier_t);
+            break;
+        }
+        }
+    }
+
+    segment_kind kind = polynomial;
+    size_t degree = 3;
+    T y_first = 0, y_last = 0;
+    vector<T> xs;
+    vector<T> ca, cb, cc, cd;
+    vector<exp_segment> exps;
+    cubic_spline<T> spline;
+    local_spline<T> local;
+    bezier_curve<T> bez;
+    size_t segment = 0;
+    double bezier_t = 0;
+};
+
+// Evaluates every curve at the same times, curve c writing out[c * n .. c * n + n).
+// Curves are spread over the pool, one task per curve.
+template<typename T>
+void evaluate_batch(vector<curve_evaluator<T>> &curves, const T *t, size_t n, T *out, task_pool &pool)
+{
+    pool.run(curves.size(), [&](size_t c) {
+        curves[c].evaluate(t, n, out + c * n);
+    });
+}
+
+// Same with times of its own for each curve, times[c] holding n values
+template<typename T>
+void evaluate_batch(vector<curve_evaluator<T>> &curves, const T *const *times, size_t n, T *out, task_pool &pool)
+{
+    pool.run(curves.size(), [&](size_t c) {
+        curves[c].evaluate(times[c], n, out + c * n);
+    });
+}
+
+}
+
+#endif // CURVE_BATCH_H
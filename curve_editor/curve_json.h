@@ -0,0 +1,366 @@
+#ifndef CURVE_JSON_H
+#define CURVE_JSON_H
+
+#include<vector>
+#include<string>
+#include<iostream>
+#include<sstream>
+#include<charconv>
+#include<system_error>
+#include<stdlib.h>
+#include<stdio.h>
+#include<string.h>
+#include<math.h>
+#include"curve_point.h"
+
+using namespace std;
+
+namespace curves {
+
+// One curve of a library, as exchanged in text form
+struct curve_entry
+{
+    string name;
+    curve_mode mode = curve_mode::linear;
+    vector<curve_point> knots;
+};
+
+static const char *const curve_mode_names[] = {
+    "linear", "log_exp", "quadratic_bezier", "cubic_bezier", "cubic_spline",
+    "monotone_cubic", "akima", "catmull_rom"
+};
+
+inline const char *mode_name(curve_mode m)
+{
+    const size_t n = sizeof(curve_mode_names) / sizeof(curve_mode_names[0]);
+    return (size_t(m) < n) ? curve_mode_names[m] : "linear";
+}
+
+inline bool mode_from_name(const string &name, curve_mode &m)
+{
+    const size_t n = sizeof(curve_mode_names) / sizeof(curve_mode_names[0]);
+    for(size_t i = 0; i < n; i++)
+    {
+        if(name == curve_mode_names[i]) {
+            m = curve_mode(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// {"curves": [{"name": "...", "mode": "cubic_spline", "knots": [[x, y, curve], ...]}, ...]}
+inline void write_json(ostream &os, const vector<curve_entry> &curves)
+{
+    char num[64];
+    auto number = [&](float v) {
+        // shortest form reading back to the same float, whatever the locale
+        *std::to_chars(num, num + sizeof(num) - 1, v).ptr = '\0';
+        return num;
+    };
+    os << "{\"curves\": [";
+    for(size_t c = 0; c < curves.size(); c++)
+    {
+        os << (c == 0 ? "\n" : ",\n") << "  {\"name\": \"";
+        for(char ch : curves[c].name)
+        {
+            if(ch == '"' || ch == '\\') os << '\\' << ch;
+            else if(ch == '\n') os << "\\n";
+            else if(static_cast<unsigned char>(ch) < 0x20) {
+                snprintf(num, sizeof(num), "\\u%04x", ch);
+                os << num;
+            }
+            else os << ch;
+        }
+        os << "\", \"mode\": \"" << mode_name(curves[c].mode) << "\", \"knots\": [";
+        const vector<curve_point> &k = curves[c].knots;
+        for(size_t i = 0; i < k.size(); i++)
+        {
+            if(i > 0) os << ", ";
+            os << '[' << number(k[i].x);
+            os << ", " << number(k[i].y);
+            os << ", " << number(k[i].curve) << ']';
+        }
+        os << "]}";
+    }
+    os << "\n]}\n";
+}
+
+// Reader for the layout written by write_json(). Unknown keys are skipped,
+// the curve factor of a knot is optional. Returns false on malformed input,
+// on values nested deeper than max_depth and on knots that are not finite.
+class curve_json_reader
+{
+public:
+
+    constexpr static const int max_depth = 64;
+
+    bool read(const string &text, vector<curve_entry> &curves)
+    {
+        s = text.c_str();
+        end = s + text.size();
+        curves.clear();
+        if(!expect('{')) return false;
+        if(peek() == '}') return true;
+        for(;;)
+        {
+            string key;
+            if(!read_string(key) || !expect(':')) return false;
+            if(key == "curves") {
+                if(!read_curves(curves)) return false;
+            } else if(!skip_value()) {
+                return false;
+            }
+            if(peek() == ',') {
+                s++;
+                continue;
+            }
+            return expect('}');
+        }
+    }
+
+private:
+
+    char peek()
+    {
+        while(s < end && (*s == ' ' || *s == '\n' || *s == '\r' || *s == '\t')) s++;
+        return (s < end) ? *s : '\0';
+    }
+
+    bool expect(char c)
+    {
+        if(peek() != c) return false;
+        s++;
+        return true;
+    }
+
+    bool read_string(string &out)
+    {
+        if(!expect('"')) return false;
+        out.clear();
+        while(s < end && *s != '"')
+        {
+            if(*s == '\\') {
+                if(++s >= end) return false;
+                switch(*s)
+                {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u':
+                {
+                    unsigned long cp;
+                    if(!read_hex4(s + 1, cp)) return false;
+                    s += 4;
+                    // a high surrogate must be followed by an escaped low one,
+                    // which is never alone
+                    if(cp >= 0xDC00 && cp <= 0xDFFF) return false;
+                    if(cp >= 0xD800 && cp <= 0xDBFF) {
+                        unsigned long low;
+                        if(end - s < 7 || s[1] != '\\' || s[2] != 'u' || !read_hex4(s + 3, low) ||
+                                low < 0xDC00 || low > 0xDFFF)
+                            return false;
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        s += 6;
+                    }
+                    append_utf8(out, cp);
+                    break;
+                }
+                default: out += *s; break;
+                }
+                s++;
+            } else {
+                out += *s++;
+            }
+        }
+        return expect('"');
+    }
+
+    // Four hex digits at p, which must hold them before the end of the text
+    bool read_hex4(const char *p, unsigned long &v) const
+    {
+        if(end - p < 4) return false;
+        v = 0;
+        for(int i = 0; i < 4; i++)
+        {
+            const char c = p[i];
+            int digit;
+            if(c >= '0' && c <= '9') digit = c - '0';
+            else if(c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+            else if(c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+            else return false;
+            v = (v << 4) | static_cast<unsigned long>(digit);
+        }
+        return true;
+    }
+
+    static void append_utf8(string &out, unsigned long cp)
+    {
+        if(cp < 0x80) out += char(cp);
+        else if(cp < 0x800) {
+            out += char(0xC0 | (cp >> 6));
+            out += char(0x80 | (cp & 0x3F));
+        } else if(cp < 0x10000) {
+            out += char(0xE0 | (cp >> 12));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        } else {
+            out += char(0xF0 | (cp >> 18));
+            out += char(0x80 | ((cp >> 12) & 0x3F));
+            out += char(0x80 | ((cp >> 6) & 0x3F));
+            out += char(0x80 | (cp & 0x3F));
+        }
+    }
+
+    // JSON numbers only : from_chars() alone would also take inf and nan.
+    // Unlike strtod() it ignores the locale, like the writer.
+    bool read_number(double &v)
+    {
+        const char c = peek();
+        const char *digits = (c == '-') ? s + 1 : s;
+        if(digits >= end || *digits < '0' || *digits > '9') return false;
+        const std::from_chars_result r = std::from_chars(s, end, v);
+        if(r.ec != std::errc()) return false;
+        s = r.ptr;
+        return true;
+    }
+
+    bool skip_value(int depth = 0)
+    {
+        if(depth > max_depth) return false;
+        const char c = peek();
+        if(c == '"') {
+            string unused;
+            return read_string(unused);
+        }
+        if(c == '{' || c == '[') {
+            const char close = (c == '{') ? '}' : ']';
+            s++;
+            if(peek() == close) {
+                s++;
+                return true;
+            }
+            for(;;)
+            {
+                if(c == '{') {
+                    string unused;
+                    if(!read_string(unused) || !expect(':')) return false;
+                }
+                if(!skip_value(depth + 1)) return false;
+                if(peek() == ',') {
+                    s++;
+                    continue;
+                }
+                return expect(close);
+            }
+        }
+        for(const char *word : {"true", "false", "null"})
+        {
+            const size_t len = strlen(word);
+            if(size_t(end - s) >= len && strncmp(s, word, len) == 0) {
+                s += len;
+                return true;
+            }
+        }
+        double unused;
+        return read_number(unused);
+    }
+
+    bool read_curves(vector<curve_entry> &curves)
+    {
+        if(!expect('[')) return false;
+        if(peek() == ']') {
+            s++;
+            return true;
+        }
+        for(;;)
+        {
+            curve_entry e;
+            if(!read_curve(e)) return false;
+            curves.push_back(std::move(e));
+            if(peek() == ',') {
+                s++;
+                continue;
+            }
+            return expect(']');
+        }
+    }
+
+    bool read_curve(curve_entry &e)
+    {
+        if(!expect('{')) return false;
+        if(peek() == '}') {
+            s++;
+            return true;
+        }
+        for(;;)
+        {
+            string key;
+            if(!read_string(key) || !expect(':')) return false;
+            if(key == "name") {
+                if(!read_string(e.name)) return false;
+            } else if(key == "mode") {
+                string m;
+                if(!read_string(m) || !mode_from_name(m, e.mode)) return false;
+            } else if(key == "knots") {
+                if(!read_knots(e.knots)) return false;
+            } else if(!skip_value()) {
+                return false;
+            }
+            if(peek() == ',') {
+                s++;
+                continue;
+            }
+            return expect('}');
+        }
+    }
+
+    bool read_knots(vector<curve_point> &knots)
+    {
+        if(!expect('[')) return false;
+        if(peek() == ']') {
+            s++;
+            return true;
+        }
+        for(;;)
+        {
+            double v[3] = {0, 0, 0};
+            if(!expect('[')) return false;
+            int n = 0;
+            for(;;)
+            {
+                if(n == 3 || !read_number(v[n])) return false;
+                n++;
+                if(peek() == ',') {
+                    s++;
+                    continue;
+                }
+                if(!expect(']') || n < 2) return false;
+                break;
+            }
+            const curve_point k = curve_point(float(v[0]), float(v[1]), float(v[2]));
+            if(!isfinite(k.x) || !isfinite(k.y) || !isfinite(k.curve)) return false;
+            knots.push_back(k);
+            if(peek() == ',') {
+                s++;
+                continue;
+            }
+            return expect(']');
+        }
+    }
+
+    const char *s = nullptr, *end = nullptr;
+};
+
+inline bool read_json(istream &is, vector<curve_entry> &curves)
+{
+    stringstream buffer;
+    buffer << is.rdbuf();
+    return curve_json_reader().read(buffer.str(), curves);
+}
+
+}
+
+#endif // CURVE_JSON_H
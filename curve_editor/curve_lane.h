@@ -0,0 +1,183 @@
+#ifndef CURVE_LANE_H
+#define CURVE_LANE_H
+
+#include<vector>
+#include<algorithm>
+#include<math.h>
+#include<elements.hpp>
+#include"curve_point.h"
+#include"log_exp.h"
+#include"spline.h"
+#include"local_spline.h"
+#include"flatten.h"
+#include"knot_list.h"
+#include"knot_index.h"
+#include"edit_history.h"
+#include"curve_publisher.h"
+
+using namespace std;
+using namespace cycfi::elements;
+
+namespace curves {
+
+// Sampled curve of one mode, valid while `version` matches the lane's samples
+struct curve_cache
+{
+    size_t version = size_t(-1);
+    // pixels per unit the curve was flattened for
+    point scale;
+    // knots [first, last) the points cover
+    size_t first = 0, last = 0;
+    vector<point> points;
+};
+
+// One curve of the editor with its mode, history, publisher and polylines.
+// Lanes only share the x axis of the editor : an edit bumps the version of
+// its own lane, so the caches of the other lanes stay valid.
+struct curve_lane
+{
+    // Knots [first, last) of the x range [x0, x1], plus the knot on each
+    // side so that segments crossing the edges are included
+    void visible_knots(float x0, float x1, size_t &first, size_t &last) const
+    {
+        first = knot_index::lower_bound_x(samples, x0);
+        last = knot_index::upper_bound_x(samples, x1);
+        if(first > 0) first--;
+        if(last < samples.size()) last++;
+    }
+
+    bool cache_valid(point scale, size_t first, size_t last) const
+    {
+        const curve_cache &cache = caches[mode];
+        return cache.version == samples_version &&
+                cache.scale.x == scale.x && cache.scale.y == scale.y &&
+                cache.first == first && cache.last == last;
+    }
+
+    // Sampled curve in relative coordinates. For the bezier modes, the points
+    // are the control points, in groups of 3 (cubic) or 2 (quadratic) after the first.
+    // Curved segments are flattened within flatten_tolerance pixels at `scale`.
+    // Only knots [first, last) are covered.
+    void build_polyline(point scale, size_t first, size_t last, float flatten_tolerance)
+    {
+        curve_cache &cache = caches[mode];
+        vector<point> &pts = cache.points;
+        pts.clear();
+        switch(mode)
+        {
+        case curve_mode::linear:
+        {
+            for(size_t i = first; i < last; i++)
+                pts.push_back(point(samples[i].x, samples[i].y));
+            break;
+        }
+        case curve_mode::cubic_bezier:
+        case curve_mode::quadratic_bezier:
+        {
+            // whole bezier segments only
+            const size_t degree = (mode == curve_mode::cubic_bezier) ? 3 : 2;
+            const size_t last_knot = ((samples.size() - 1) / degree) * degree;
+            const size_t begin = (first / degree) * degree;
+            const size_t end = std::min(last_knot, ((last + degree - 2) / degree) * degree) + 1;
+            for(size_t i = begin; i < end; i++)
+                pts.push_back(point(samples[i].x, samples[i].y));
+            break;
+        }
+        case curve_mode::log_exp:
+        {
+            const curve_flattener flattener(scale.x, scale.y, flatten_tolerance);
+            pts.push_back(point(samples[first].x, samples[first].y));
+            for(size_t i = first; i + 1 < last; i++) {
+                const curve_point &beg = samples[i], &end = samples[i + 1];
+                if(beg.curve == 0.0f) {
+                    pts.push_back(point(end.x, end.y));
+                    continue;
+                }
+                const float curve = (beg.y > end.y) ? -beg.curve : beg.curve;
+                const log_exp_segment<float> seg(beg.y, end.y, 2, curve);
+                const float dx = end.x - beg.x;
+                flattener.flatten([&](double u) {
+                    return point(beg.x + float(u) * dx, seg.at(u));
+                }, pts);
+            }
+            break;
+        }
+        case curve_mode::cubic_spline:
+        {
+            if(samples.size() < 3) break;
+            if(spline_version != samples_version) {
+                if(moved_sample >= 0 && spline_version == moved_base) spline.update_coefficients(samples, moved_sample);
+                else spline.build(samples);
+                moved_sample = -1;
+                moved_base = spline_version = samples_version;
+            }
+
+            const curve_flattener flattener(scale.x, scale.y, flatten_tolerance);
+            pts.push_back(point(samples[first].x, samples[first].y));
+            for(int i = int(first); i + 1 < int(last); i++)
+            {
+                const float x0 = spline.knot_x(i), dx = spline.knot_x(i + 1) - x0;
+                flattener.flatten([&](double u) {
+                    const float xv = x0 + float(u) * dx;
+                    return point(xv, std::clamp(spline.segment_value(i, xv), 0.0f, 1.0f));
+                }, pts);
+            }
+            break;
+        }
+        case curve_mode::monotone_cubic:
+        case curve_mode::akima:
+        case curve_mode::catmull_rom:
+        {
+            if(samples.size() < 2) break;
+            if(local_version != samples_version || local.built_mode() != mode) {
+                if(moved_sample >= 0 && local_version == moved_base && local.built_mode() == mode)
+                    local.update_point(samples, moved_sample);
+                else local.build(samples, mode);
+                moved_sample = -1;
+                moved_base = local_version = samples_version;
+            }
+
+            const curve_flattener flattener(scale.x, scale.y, flatten_tolerance);
+            pts.push_back(point(samples[first].x, samples[first].y));
+            for(int i = int(first); i + 1 < int(last); i++)
+            {
+                const float x0 = local.knot_x(i), dx = local.knot_x(i + 1) - x0;
+                flattener.flatten([&](double u) {
+                    const float xv = x0 + float(u) * dx;
+                    return point(xv, std::clamp(local.segment_value(i, xv), 0.0f, 1.0f));
+                }, pts);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        cache.version = samples_version;
+        cache.scale = scale;
+        cache.first = first;
+        cache.last = last;
+    }
+
+    knot_list samples;
+    curve_mode mode = curve_mode::linear;
+    // bumped on every edit of samples or of a curve factor
+    size_t samples_version = 0;
+    // sample moved since the last spline rebuild, -1 for none, -2 for several
+    int moved_sample = -1;
+    // version moved_sample counts from : only the spline built at it can update incrementally
+    size_t moved_base = size_t(-1);
+    size_t spline_version = size_t(-1);
+    size_t local_version = size_t(-1);
+    cubic_spline<float> spline;
+    local_spline<float> local;
+    curve_cache caches[curve_mode_count];
+    knot_index knots_index;
+    edit_history<knot_list> history;
+    curve_publisher<float> publisher;
+    size_t published_version = 0;
+    curve_mode published_mode = curve_mode::linear;
+};
+
+}
+
+#endif // CURVE_LANE_H
@@ -0,0 +1,310 @@
+#ifndef CURVE_LIBRARY_H
+#define CURVE_LIBRARY_H
+
+#include<vector>
+#include<string>
+#include<iostream>
+#include<cstdint>
+#include<memory.h>
+#include<fcntl.h>
+#include<unistd.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include"curve_point.h"
+#include"knot_list.h"
+
+using namespace std;
+
+namespace curves {
+
+// Curve library file, every number little-endian :
+//   header  "CRVL", u32 version, u32 curve count, u32 reserved, u64 index offset
+//   knots   x, y, curve as f32, curve after curve
+//   names   utf-8, not terminated
+//   index   per curve : u64 knots offset, u64 knot count, u64 name offset,
+//           u32 name size, u32 mode
+// The index is at the end so that curves can be streamed to disk.
+namespace library_format {
+    constexpr static const char magic[4] = {'C', 'R', 'V', 'L'};
+    constexpr static const uint32_t version = 1;
+    constexpr static const size_t header_size = 24;
+    constexpr static const size_t knot_size = 12;
+    constexpr static const size_t entry_size = 32;
+
+    inline void put_u32(uint8_t *p, uint32_t v)
+    {
+        for(int i = 0; i < 4; i++) p[i] = uint8_t(v >> (8 * i));
+    }
+
+    inline void put_u64(uint8_t *p, uint64_t v)
+    {
+        for(int i = 0; i < 8; i++) p[i] = uint8_t(v >> (8 * i));
+    }
+
+    inline void put_f32(uint8_t *p, float v)
+    {
+        uint32_t bits;
+        ::memcpy(&bits, &v, 4);
+        put_u32(p, bits);
+    }
+
+    inline uint32_t get_u32(const uint8_t *p)
+    {
+        return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    inline uint64_t get_u64(const uint8_t *p)
+    {
+        return uint64_t(get_u32(p)) | (uint64_t(get_u32(p + 4)) << 32);
+    }
+
+    inline float get_f32(const uint8_t *p)
+    {
+        const uint32_t bits = get_u32(p);
+        float v;
+        ::memcpy(&v, &bits, 4);
+        return v;
+    }
+}
+
+// Streams curves to a library file : knots are written as curves are added,
+// only the index is kept in memory until close()
+class curve_library_writer
+{
+public:
+
+    ~curve_library_writer()
+    {
+        close();
+    }
+
+    bool open(const string &path)
+    {
+        close();
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) return false;
+        offset = library_format::header_size;
+        entries.clear();
+        names.clear();
+        ok = true;
+        return true;
+    }
+
+    template<typename Points>
+    void add(const string &name, curve_mode mode, const Points &knots)
+    {
+        if(fd < 0) return;
+        entry e{offset, knots.size(), names.size(), uint32_t(name.size()), uint32_t(mode)};
+        names += name;
+        buffer.resize(knots.size() * library_format::knot_size);
+        uint8_t *p = buffer.data();
+        for(auto & it : knots)
+        {
+            library_format::put_f32(p, it.x);
+            library_format::put_f32(p + 4, it.y);
+            library_format::put_f32(p + 8, it.curve);
+            p += library_format::knot_size;
+        }
+        write_all(buffer.data(), buffer.size());
+        entries.push_back(e);
+    }
+
+    // Writes the names, the index and the header, returns false if any write failed
+    bool close()
+    {
+        if(fd < 0) return false;
+        const uint64_t names_offset = offset;
+        write_all(reinterpret_cast<const uint8_t *>(names.data()), names.size());
+
+        const uint64_t index_offset = offset;
+        buffer.resize(entries.size() * library_format::entry_size);
+        uint8_t *p = buffer.data();
+        for(auto & it : entries)
+        {
+            library_format::put_u64(p, it.knots_offset);
+            library_format::put_u64(p + 8, it.knot_count);
+            library_format::put_u64(p + 16, names_offset + it.name_offset);
+            library_format::put_u32(p + 24, it.name_size);
+            library_format::put_u32(p + 28, it.mode);
+            p += library_format::entry_size;
+        }
+        write_all(buffer.data(), buffer.size());
+
+        uint8_t hdr[library_format::header_size];
+        ::memcpy(hdr, library_format::magic, 4);
+        library_format::put_u32(hdr + 4, library_format::version);
+        library_format::put_u32(hdr + 8, uint32_t(entries.size()));
+        library_format::put_u32(hdr + 12, 0);
+        library_format::put_u64(hdr + 16, index_offset);
+        if(::pwrite(fd, hdr, sizeof(hdr), 0) != ssize_t(sizeof(hdr))) ok = false;
+
+        ::close(fd);
+        fd = -1;
+        if(!ok) cerr << "curve_library_writer : write failed" << endl;
+        return ok;
+    }
+
+private:
+
+    struct entry
+    {
+        uint64_t knots_offset, knot_count, name_offset;
+        uint32_t name_size, mode;
+    };
+
+    void write_all(const uint8_t *data, size_t size)
+    {
+        while(size > 0)
+        {
+            const ssize_t written = ::pwrite(fd, data, size, off_t(offset));
+            if(written <= 0) {
+                ok = false;
+                return;
+            }
+            data += written;
+            size -= size_t(written);
+            offset += uint64_t(written);
+        }
+    }
+
+    int fd = -1;
+    bool ok = true;
+    uint64_t offset = 0;
+    vector<entry> entries;
+    string names;
+    vector<uint8_t> buffer;
+};
+
+// Read-only view of a library file mapped in memory.
+// open() only checks the header and the index bounds : a curve is decoded
+// when it is loaded, and the pages of the others are never touched.
+class curve_library
+{
+public:
+
+    ~curve_library()
+    {
+        close();
+    }
+
+    bool open(const string &path)
+    {
+        close();
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0) return false;
+        struct stat st;
+        if(::fstat(fd, &st) != 0 || size_t(st.st_size) < library_format::header_size) {
+            ::close(fd);
+            return false;
+        }
+        mapped_size = size_t(st.st_size);
+        void *m = ::mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(m == MAP_FAILED) return false;
+        data = static_cast<const uint8_t *>(m);
+
+        const uint64_t index_offset = library_format::get_u64(data + 16);
+        count = library_format::get_u32(data + 8);
+        if(::memcmp(data, library_format::magic, 4) != 0 ||
+                library_format::get_u32(data + 4) != library_format::version ||
+                index_offset > mapped_size ||
+                uint64_t(count) > (mapped_size - index_offset) / library_format::entry_size) {
+            close();
+            return false;
+        }
+        index = data + index_offset;
+        return true;
+    }
+
+    void close()
+    {
+        if(data != nullptr) ::munmap(const_cast<uint8_t *>(data), mapped_size);
+        data = nullptr;
+        index = nullptr;
+        mapped_size = 0;
+        count = 0;
+    }
+
+    bool is_open() const {return data != nullptr;}
+    size_t size() const {return count;}
+
+    string name(size_t i) const
+    {
+        const uint8_t *e = entry(i);
+        const uint64_t off = library_format::get_u64(e + 16);
+        const uint32_t len = library_format::get_u32(e + 24);
+        if(off > mapped_size || len > mapped_size - off) return string();
+        return string(reinterpret_cast<const char *>(data + off), len);
+    }
+
+    // Mode of curve i, returns false if the stored value is not a known mode
+    bool mode(size_t i, curve_mode &m) const
+    {
+        const uint32_t stored = library_format::get_u32(entry(i) + 28);
+        if(stored >= uint32_t(curve_mode_count)) return false;
+        m = curve_mode(stored);
+        return true;
+    }
+
+    size_t knot_count(size_t i) const
+    {
+        return size_t(library_format::get_u64(entry(i) + 8));
+    }
+
+    // Index of the first curve with this name, or -1
+    int find(const string &n) const
+    {
+        for(size_t i = 0; i < count; i++)
+        {
+            const uint8_t *e = entry(i);
+            const uint64_t off = library_format::get_u64(e + 16);
+            const uint32_t len = library_format::get_u32(e + 24);
+            if(len == n.size() && len <= mapped_size && off <= mapped_size - len &&
+                    ::memcmp(data + off, n.data(), len) == 0)
+                return int(i);
+        }
+        return -1;
+    }
+
+    // Decodes curve i, returns false if its knots lie outside of the file
+    bool load(size_t i, vector<curve_point> &knots) const
+    {
+        const uint8_t *e = entry(i);
+        const uint64_t off = library_format::get_u64(e);
+        const uint64_t n = library_format::get_u64(e + 8);
+        if(off > mapped_size || n > (mapped_size - off) / library_format::knot_size) return false;
+        knots.resize(size_t(n));
+        const uint8_t *p = data + off;
+        for(auto & it : knots)
+        {
+            it = curve_point(library_format::get_f32(p), library_format::get_f32(p + 4),
+                             library_format::get_f32(p + 8));
+            p += library_format::knot_size;
+        }
+        return true;
+    }
+
+    bool load(size_t i, knot_list &knots) const
+    {
+        vector<curve_point> decoded;
+        if(!load(i, decoded)) return false;
+        knots.assign(decoded);
+        return true;
+    }
+
+private:
+
+    const uint8_t *entry(size_t i) const
+    {
+        return index + i * library_format::entry_size;
+    }
+
+    const uint8_t *data = nullptr;
+    const uint8_t *index = nullptr;
+    size_t mapped_size = 0;
+    size_t count = 0;
+};
+
+}
+
+#endif // CURVE_LIBRARY_H
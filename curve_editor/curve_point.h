@@ -4,8 +4,24 @@
 
 using namespace cycfi::elements;
 
+enum curve_mode {
+        linear = 0,
+        log_exp = 1,
+        quadratic_bezier = 2,
+        cubic_bezier = 3,
+        cubic_spline = 4,
+        monotone_cubic = 5,
+        akima = 6,
+        catmull_rom = 7,
+};
+
+constexpr static const int curve_mode_count = 8;
+
 struct curve_point : public point
 {
+    curve_point() : point(0, 0), curve(0)
+    {}
+
     curve_point(float x_, float y_, float curve_) : point(x_, y_), curve(curve_)
     {}
 
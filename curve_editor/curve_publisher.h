@@ -0,0 +1,94 @@
+#ifndef CURVE_PUBLISHER_H
+#define CURVE_PUBLISHER_H
+
+#include<vector>
+#include<atomic>
+#include"curve_point.h"
+#include"curve_table.h"
+
+namespace curves {
+
+// Immutable state of a curve as seen by consumers
+template<typename T>
+struct curve_snapshot
+{
+    vector<curve_point> knots;
+    curve_mode mode;
+    vector<T> table;
+    size_t version;
+};
+
+// Ships curve snapshots from the editor to one real-time consumer.
+// Publishing is a single atomic pointer exchange. The consumer announces the
+// snapshot it reads in a hazard pointer, so the editor thread knows which
+// retired snapshots it can free : the consumer never locks, allocates, frees,
+// nor sees a partially written curve.
+template<typename T>
+class curve_publisher
+{
+public:
+
+    ~curve_publisher()
+    {
+        delete current.exchange(nullptr);
+        for(auto & it : retired) delete it;
+    }
+
+    // Editor thread
+    void publish(curve_snapshot<T> *snapshot)
+    {
+        curve_snapshot<T> *old = current.exchange(snapshot);
+        if(old != nullptr) retired.push_back(old);
+        collect();
+    }
+
+    // Editor thread, renders the table before publishing
+    template<typename Points>
+    void publish(const Points &knots, curve_mode mode, size_t table_size, size_t version)
+    {
+        auto *snapshot = new curve_snapshot<T>{vector<curve_point>(knots.begin(), knots.end()), mode, vector<T>(table_size), version};
+        table.render(snapshot->knots, mode, snapshot->table.data(), table_size);
+        publish(snapshot);
+    }
+
+    // Editor thread, frees the retired snapshots the consumer is not reading
+    void collect()
+    {
+        const curve_snapshot<T> *in_use = hazard.load();
+        size_t kept = 0;
+        for(auto & it : retired)
+        {
+            if(it == in_use) retired[kept++] = it;
+            else delete it;
+        }
+        retired.resize(kept);
+    }
+
+    // Consumer thread : the snapshot stays valid until release()
+    const curve_snapshot<T> *acquire()
+    {
+        curve_snapshot<T> *s = current.load();
+        for(;;)
+        {
+            hazard.store(s);
+            curve_snapshot<T> *check = current.load();
+            if(check == s) return s;
+            s = check;
+        }
+    }
+
+    void release()
+    {
+        hazard.store(nullptr);
+    }
+
+private:
+    std::atomic<curve_snapshot<T> *> current {nullptr};
+    std::atomic<curve_snapshot<T> *> hazard {nullptr};
+    vector<curve_snapshot<T> *> retired;
+    curve_table<T> table;
+};
+
+}
+
+#endif // CURVE_PUBLISHER_H
@@ -0,0 +1,183 @@
+#ifndef CURVE_TABLE_H
+#define CURVE_TABLE_H
+
+#include<vector>
+#include<algorithm>
+#include<math.h>
+#include"curve_point.h"
+#include"log_exp.h"
+#include"spline.h"
+#include"bezier.h"
+#include"local_spline.h"
+
+namespace curves {
+
+// Renders a curve into a lookup table, without any drawing involved.
+// Entry i is the curve at x = i / (size - 1). The editor stores y growing
+// downward, so the table holds 1 - y : the top of the editor is 1.
+// Outside of the first and last knots the end values are held.
+// With `normalize`, the table is rescaled to span [0, 1].
+template<typename T>
+class curve_table
+{
+public:
+
+    template<typename Points>
+    void render(const Points &p, curve_mode mode, T *out, size_t size,
+                bool normalize = false)
+    {
+        if(size == 0) return;
+        if(p.empty()) {
+            std::fill(out, out + size, T(0));
+            return;
+        }
+        if(size == 1) {
+            T ends[2] = {0, 0};
+            render(p, mode, ends, 2, false);
+            out[0] = ends[0];
+            return;
+        }
+        step = 1.0 / double(size - 1);
+
+        switch(mode)
+        {
+        case curve_mode::linear:
+            render_linear(p, out, size);
+            break;
+        case curve_mode::log_exp:
+            render_log_exp(p, out, size);
+            break;
+        case curve_mode::cubic_spline:
+            if(p.size() < 3) {
+                render_linear(p, out, size);
+                break;
+            }
+            spline.build(p);
+            spline.sample(out, int(size), T(step));
+            break;
+        case curve_mode::cubic_bezier:
+            render_bezier(p, 3, out, size);
+            break;
+        case curve_mode::quadratic_bezier:
+            render_bezier(p, 2, out, size);
+            break;
+        case curve_mode::monotone_cubic:
+        case curve_mode::akima:
+        case curve_mode::catmull_rom:
+            local.build(p, mode);
+            local.sample(out, int(size), T(step));
+            break;
+        }
+
+        for(size_t i = 0; i < size; i++)
+            out[i] = T(1) - out[i];
+        if(normalize) normalize_table(out, size);
+    }
+
+    template<typename Points>
+    vector<T> render(const Points &p, curve_mode mode, size_t size,
+                     bool normalize = false)
+    {
+        vector<T> table(size);
+        render(p, mode, table.data(), size, normalize);
+        return table;
+    }
+
+private:
+
+    // Table indices [first, last) of the x interval [x0, x1), the last
+    // interval including its end
+    void index_range(double x0, double x1, bool closed, size_t size,
+                     size_t &first, size_t &last) const
+    {
+        auto lower = [&](double x) {
+            double v = ceil(x / step);
+            size_t i = size_t(std::clamp(v, 0.0, double(size)));
+            while(i > 0 && double(i - 1) * step >= x) i--;
+            while(i < size && double(i) * step < x) i++;
+            return i;
+        };
+        first = lower(x0);
+        last = lower(x1);
+        if(closed) {
+            while(last < size && double(last) * step <= x1) last++;
+        }
+        if(last < first) last = first;
+    }
+
+    void hold_ends(T y_begin, double x_begin, T y_end, double x_end, T *out, size_t size)
+    {
+        for(size_t j = 0; j < size && double(j) * step < x_begin; j++)
+            out[j] = y_begin;
+        for(size_t j = size; j > 0 && double(j - 1) * step > x_end; j--)
+            out[j - 1] = y_end;
+    }
+
+    template<typename Points>
+    void render_linear(const Points &p, T *out, size_t size)
+    {
+        hold_ends(p.front().y, p.front().x, p.back().y, p.back().x, out, size);
+        for(size_t i = 0; i + 1 < p.size(); i++)
+        {
+            size_t first, last;
+            index_range(p[i].x, p[i + 1].x, i + 2 == p.size(), size, first, last);
+            const double dx = p[i + 1].x - p[i].x;
+            for(size_t j = first; j < last; j++)
+            {
+                const double u = (dx > 0.0) ? (double(j) * step - p[i].x) / dx : 0.0;
+                out[j] = T(p[i].y + (p[i + 1].y - p[i].y) * u);
+            }
+        }
+    }
+
+    // Same shape as the editor : the curve factor of a knot shapes the segment
+    // that follows it, mirrored when the segment goes down
+    template<typename Points>
+    void render_log_exp(const Points &p, T *out, size_t size)
+    {
+        hold_ends(p.front().y, p.front().x, p.back().y, p.back().x, out, size);
+        for(size_t i = 0; i + 1 < p.size(); i++)
+        {
+            size_t first, last;
+            index_range(p[i].x, p[i + 1].x, i + 2 == p.size(), size, first, last);
+            if(last == first) continue;
+            const double dx = p[i + 1].x - p[i].x;
+            const float curve = (p[i].y > p[i + 1].y) ? -p[i].curve : p[i].curve;
+            const log_exp_segment<T> seg(p[i].y, p[i + 1].y, int(last - first), curve);
+            const double u0 = (dx > 0.0) ? (double(first) * step - p[i].x) / dx : 0.0;
+            const double du = (dx > 0.0) ? step / dx : 0.0;
+            seg.render_at(out + first, int(last - first), u0, du);
+        }
+    }
+
+    // Bezier segments sampled as y(x), see bezier_curve
+    template<typename Points>
+    void render_bezier(const Points &p, size_t degree, T *out, size_t size)
+    {
+        if(p.size() < degree + 1) {
+            render_linear(p, out, size);
+            return;
+        }
+        bezier.build(p, degree);
+        bezier.render(T(0), T(step), size, out);
+    }
+
+    static void normalize_table(T *out, size_t size)
+    {
+        const auto mm = std::minmax_element(out, out + size);
+        const T mn = *mm.first, mx = *mm.second;
+        if(mx <= mn) return;
+        const T scale = T(1) / (mx - mn);
+        for(size_t i = 0; i < size; i++)
+            out[i] = (out[i] - mn) * scale;
+    }
+
+    double step = 0;
+    cubic_spline<T> spline;
+    bezier_curve<T> bezier;
+    local_spline<T> local;
+};
+
+}
+
+#endif // CURVE_TABLE_H
@@ -0,0 +1,63 @@
+#ifndef EDIT_HISTORY_H
+#define EDIT_HISTORY_H
+
+#include<deque>
+#include<vector>
+
+namespace curves {
+
+// Bounded undo / redo stacks of states.
+// States are stored by value : with a structurally shared State such as
+// knot_list, a step costs what the edit copied, not the whole state.
+template<typename State>
+class edit_history
+{
+public:
+
+    edit_history(size_t capacity = 512) : capacity_(capacity)
+    {}
+
+    // Saves the state an edit is about to change, drops the redo steps
+    void record(const State &before)
+    {
+        undo_stack.push_back(before);
+        if(undo_stack.size() > capacity_) undo_stack.pop_front();
+        redo_stack.clear();
+    }
+
+    bool undo(State &current)
+    {
+        if(undo_stack.empty()) return false;
+        redo_stack.push_back(current);
+        current = undo_stack.back();
+        undo_stack.pop_back();
+        return true;
+    }
+
+    bool redo(State &current)
+    {
+        if(redo_stack.empty()) return false;
+        undo_stack.push_back(current);
+        current = redo_stack.back();
+        redo_stack.pop_back();
+        return true;
+    }
+
+    bool can_undo() const {return !undo_stack.empty();}
+    bool can_redo() const {return !redo_stack.empty();}
+
+    void clear()
+    {
+        undo_stack.clear();
+        redo_stack.clear();
+    }
+
+private:
+    size_t capacity_;
+    std::deque<State> undo_stack;
+    std::vector<State> redo_stack;
+};
+
+}
+
+#endif // EDIT_HISTORY_H
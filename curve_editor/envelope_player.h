@@ -0,0 +1,66 @@
+#ifndef ENVELOPE_PLAYER_H
+#define ENVELOPE_PLAYER_H
+
+#include<stddef.h>
+
+namespace curves {
+
+// Reads a lookup table at audio rate with linear interpolation.
+// The table is not owned : the player never allocates nor locks, so process()
+// can run on a real-time thread. Once the end is reached the last value is held.
+template<typename T>
+class envelope_player
+{
+public:
+
+    envelope_player() {}
+
+    envelope_player(const T *table, size_t size) : table_(table), size_(size)
+    {}
+
+    void set_table(const T *table, size_t size)
+    {
+        table_ = table;
+        size_ = size;
+        if(size_ > 0 && phase > double(size_ - 1)) phase = double(size_ - 1);
+    }
+
+    // Plays the whole table in `duration` seconds
+    void start(double duration, double sample_rate)
+    {
+        phase = 0;
+        increment = (size_ > 1 && duration > 0) ? double(size_ - 1) / (duration * sample_rate) : 0.0;
+    }
+
+    void process(T *out, size_t n)
+    {
+        if(table_ == nullptr || size_ == 0) {
+            for(size_t i = 0; i < n; i++) out[i] = T(0);
+            return;
+        }
+        const double end = double(size_ - 1);
+        size_t i = 0;
+        for(; i < n && phase < end; i++)
+        {
+            const size_t idx = size_t(phase);
+            const T frac = T(phase - double(idx));
+            out[i] = table_[idx] + (table_[idx + 1] - table_[idx]) * frac;
+            phase += increment;
+        }
+        for(; i < n; i++)
+            out[i] = table_[size_ - 1];
+    }
+
+    bool finished() const {return size_ == 0 || phase >= double(size_ - 1);}
+
+    double position() const {return phase;}
+
+private:
+    const T *table_ = nullptr;
+    size_t size_ = 0;
+    double phase = 0, increment = 0;
+};
+
+}
+
+#endif // ENVELOPE_PLAYER_H
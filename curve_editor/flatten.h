@@ -0,0 +1,72 @@
+#ifndef FLATTEN_H
+#define FLATTEN_H
+
+#include<vector>
+#include<math.h>
+#include<algorithm>
+#include<elements.hpp>
+
+using namespace std;
+using namespace cycfi::elements;
+
+namespace curves {
+
+// Adaptive flattening of a curve f(u), u in [0, 1], given in relative coordinates.
+// An interval is split in two while the curve at its quarter, half and three
+// quarter points strays further than `tolerance` from the chord, measured after
+// scaling by (sx, sy) : flat parts get few vertices and curved parts many,
+// whatever the length of the curve.
+class curve_flattener
+{
+public:
+
+    constexpr static const int max_depth = 16;
+
+    curve_flattener(float sx, float sy, float tolerance) :
+        sx_(sx), sy_(sy), tolerance_(tolerance)
+    {}
+
+    // Appends the vertices following f(0), up to and including f(1)
+    template<typename F>
+    void flatten(F &&f, vector<point> &out) const
+    {
+        subdivide(f, 0.0, 1.0, f(0.0), f(1.0), 0, out);
+    }
+
+private:
+
+    template<typename F>
+    void subdivide(F &f, double u0, double u1, point p0, point p1, int depth, vector<point> &out) const
+    {
+        const double um = (u0 + u1) / 2.0;
+        const point pm = f(um);
+        if(depth < max_depth &&
+                (deviation(pm, p0, p1) > tolerance_ ||
+                 deviation(f((u0 + um) / 2.0), p0, p1) > tolerance_ ||
+                 deviation(f((um + u1) / 2.0), p0, p1) > tolerance_)) {
+            subdivide(f, u0, um, p0, pm, depth + 1, out);
+            subdivide(f, um, u1, pm, p1, depth + 1, out);
+            return;
+        }
+        out.push_back(p1);
+    }
+
+    // Screen distance from p to the chord [a, b]
+    float deviation(const point &p, const point &a, const point &b) const
+    {
+        const float ax = a.x * sx_, ay = a.y * sy_;
+        const float dx = b.x * sx_ - ax, dy = b.y * sy_ - ay;
+        const float px = p.x * sx_ - ax, py = p.y * sy_ - ay;
+        const float len2 = dx * dx + dy * dy;
+        if(len2 == 0.0f) return sqrt(px * px + py * py);
+        const float t = std::clamp((px * dx + py * dy) / len2, 0.0f, 1.0f);
+        const float ex = px - t * dx, ey = py - t * dy;
+        return sqrt(ex * ex + ey * ey);
+    }
+
+    float sx_, sy_, tolerance_;
+};
+
+}
+
+#endif // FLATTEN_H
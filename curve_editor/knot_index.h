@@ -0,0 +1,202 @@
+#ifndef KNOT_INDEX_H
+#define KNOT_INDEX_H
+
+#include<vector>
+#include<algorithm>
+#include<math.h>
+#include"curve_point.h"
+#include"knot_list.h"
+
+namespace curves {
+
+// Lookups over knots sorted by x.
+// Knots within a distance are first narrowed down to an x range by binary
+// search. When that range is crowded (knots stacked vertically), a grid of
+// columns as wide as the search distance, each sorted by y, is used instead.
+// It only covers the crowded range, and is kept while the knots keep their
+// version and the queries fall inside that range. A dragged knot is followed
+// by knot_moved() in linear time, so dragging never sorts the grid again.
+class knot_index
+{
+public:
+
+    constexpr static const size_t crowded = 32;
+    // cells of the grid beyond the search distance on each side
+    constexpr static const size_t grid_margin = 2;
+
+    // First knot with x >= xval
+    template<typename Points>
+    static size_t lower_bound_x(const Points &p, float xval)
+    {
+        size_t lo = 0, hi = p.size();
+        while(lo < hi)
+        {
+            const size_t mid = (lo + hi) / 2;
+            if(p[mid].x < xval) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    // First knot with x > xval
+    template<typename Points>
+    static size_t upper_bound_x(const Points &p, float xval)
+    {
+        size_t lo = 0, hi = p.size();
+        while(lo < hi)
+        {
+            const size_t mid = (lo + hi) / 2;
+            if(p[mid].x <= xval) lo = mid + 1;
+            else hi = mid;
+        }
+        return lo;
+    }
+
+    static size_t lower_bound_x(const knot_list &p, float xval) {return p.lower_bound(xval);}
+    static size_t upper_bound_x(const knot_list &p, float xval) {return p.upper_bound(xval);}
+
+    // Segment i such that p[i].x < xval < p[i + 1].x, or -1
+    template<typename Points>
+    static int find_segment(const Points &p, float xval)
+    {
+        if(p.size() < 2) return -1;
+        const size_t ub = upper_bound_x(p, xval);
+        if(ub == 0 || ub >= p.size()) return -1;
+        const size_t i = ub - 1;
+        return (p[i].x < xval) ? int(i) : -1;
+    }
+
+    // Closest knot closer than `distance` to pos, or -1.
+    // x distances are multiplied by x_scale, for views zoomed horizontally.
+    template<typename Points>
+    int find_nearest(const Points &p, const point &pos, float distance, size_t version,
+                     float x_scale = 1.0f)
+    {
+        const float x_distance = distance / x_scale;
+        const size_t first = lower_bound_x(p, pos.x - x_distance);
+        const size_t last = upper_bound_x(p, pos.x + x_distance);
+        if(last - first <= crowded) {
+            int best = -1;
+            float best_dist = distance;
+            for(size_t i = first; i < last; i++)
+            {
+                const float d = distance_between(p[i], pos, x_scale);
+                if(d < best_dist) {
+                    best_dist = d;
+                    best = int(i);
+                }
+            }
+            return best;
+        }
+
+        if(version != built_version || x_distance != cell || first < built_first || last > built_last) {
+            // a few cells more on each side, for the next queries around pos
+            const float margin = x_distance * float(grid_margin + 1);
+            build(p, lower_bound_x(p, pos.x - margin), upper_bound_x(p, pos.x + margin), x_distance, version);
+        }
+
+        int best = -1;
+        float best_dist = distance;
+        const long col = column_of(pos.x);
+        for(long c = col - 1; c <= col + 1; c++)
+        {
+            auto it = std::lower_bound(columns.begin(), columns.end(), entry{c, pos.y - distance, 0});
+            for(; it != columns.end() && it->column == c && it->y <= pos.y + distance; ++it)
+            {
+                const float d = distance_between(p[it->index], pos, x_scale);
+                if(d < best_dist) {
+                    best_dist = d;
+                    best = int(it->index);
+                }
+            }
+        }
+        return best;
+    }
+
+    // Knot `from` of the knots at version `before` is now knot `to` of `p`, at
+    // version `after`, nothing else changed : its grid entry is moved and the
+    // indices it passed over are shifted. A grid built for another version, or
+    // whose index range the knot entered or left, is dropped and rebuilt on demand.
+    template<typename Points>
+    void knot_moved(const Points &p, size_t from, size_t to, size_t before, size_t after)
+    {
+        if(built_version != before) return;
+        const bool was_in = from >= built_first && from < built_last;
+        const bool is_in = to >= built_first && to < built_last;
+        if(was_in != is_in) {
+            built_version = size_t(-1);
+            return;
+        }
+        built_version = after;
+        if(!was_in && (from < built_first) == (to < built_first)) return;
+        if(!was_in) {
+            // passed over the whole range from one side to the other
+            built_version = size_t(-1);
+            return;
+        }
+        size_t old_pos = columns.size();
+        for(size_t i = 0; i < columns.size(); i++)
+        {
+            size_t &index = columns[i].index;
+            if(index == from) old_pos = i;
+            else if(from < to && index > from && index <= to) index--;
+            else if(to < from && index >= to && index < from) index++;
+        }
+        if(old_pos == columns.size()) {
+            built_version = size_t(-1);
+            return;
+        }
+        columns.erase(columns.begin() + old_pos);
+        const entry e{column_of(p[to].x), p[to].y, to};
+        columns.insert(std::upper_bound(columns.begin(), columns.end(), e), e);
+    }
+
+private:
+
+    struct entry
+    {
+        long column;
+        float y;
+        size_t index;
+
+        bool operator<(const entry &o) const
+        {
+            return (column != o.column) ? column < o.column : y < o.y;
+        }
+    };
+
+    template<typename P>
+    static float distance_between(const P &a, const point &b, float x_scale)
+    {
+        const float dx = (a.x - b.x) * x_scale, dy = a.y - b.y;
+        return sqrt(dx * dx + dy * dy);
+    }
+
+    long column_of(float x) const
+    {
+        return long(floor(x / cell));
+    }
+
+    // Grid of knots [first, last)
+    template<typename Points>
+    void build(const Points &p, size_t first, size_t last, float distance, size_t version)
+    {
+        cell = distance;
+        columns.resize(last - first);
+        for(size_t i = first; i < last; i++)
+            columns[i - first] = entry{column_of(p[i].x), p[i].y, i};
+        std::sort(columns.begin(), columns.end());
+        built_first = first;
+        built_last = last;
+        built_version = version;
+    }
+
+    std::vector<entry> columns;
+    float cell = 0;
+    size_t built_first = 0, built_last = 0;
+    size_t built_version = size_t(-1);
+};
+
+}
+
+#endif // KNOT_INDEX_H
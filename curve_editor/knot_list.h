@@ -0,0 +1,373 @@
+#ifndef KNOT_LIST_H
+#define KNOT_LIST_H
+
+#include<vector>
+#include<memory>
+#include<algorithm>
+#include<iterator>
+#include"curve_point.h"
+
+namespace curves {
+
+// Knots kept sorted by x in a persistent B+ tree.
+// Leaves hold up to leaf_size contiguous knots, inner nodes up to fanout
+// children along with the knot count and first x of every subtree, so a knot
+// is found by x or by index in O(log n).
+// Nodes are immutable and shared : an edit copies the path from the root to
+// one leaf, and copying a knot_list is O(1). A copy is a snapshot that later
+// edits of either list never alter, which is what the undo history keeps.
+class knot_list
+{
+    struct node;
+    using node_ptr = std::shared_ptr<const node>;
+
+    struct node
+    {
+        size_t count = 0;
+        float min_x = 0;
+        std::vector<curve_point> knots;   // leaves
+        std::vector<node_ptr> children;   // inner nodes
+
+        bool leaf() const {return children.empty();}
+
+        void refresh()
+        {
+            if(leaf()) {
+                count = knots.size();
+                min_x = knots.empty() ? 0.0f : knots.front().x;
+                return;
+            }
+            count = 0;
+            for(auto & it : children) count += it->count;
+            min_x = children.front()->min_x;
+        }
+
+        size_t width() const {return leaf() ? knots.size() : children.size();}
+    };
+
+public:
+
+    constexpr static const size_t leaf_size = 64;
+    constexpr static const size_t fanout = 32;
+
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = curve_point;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const curve_point *;
+        using reference = const curve_point &;
+
+        const_iterator(const knot_list *l, size_t i) : list(l), index(i)
+        {
+            if(index < list->count) leaf = list->leaf_of(index, local);
+        }
+
+        reference operator*() const {return leaf->knots[local];}
+        pointer operator->() const {return &leaf->knots[local];}
+
+        const_iterator &operator++()
+        {
+            index++;
+            if(++local == leaf->knots.size())
+                leaf = (index < list->count) ? list->leaf_of(index, local) : nullptr;
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator prev = *this;
+            ++(*this);
+            return prev;
+        }
+
+        bool operator==(const const_iterator &o) const {return index == o.index;}
+        bool operator!=(const const_iterator &o) const {return !(*this == o);}
+
+    private:
+        const knot_list *list;
+        const node *leaf = nullptr;
+        size_t index, local = 0;
+    };
+
+    knot_list() {}
+
+    knot_list(const std::vector<curve_point> &sorted)
+    {
+        assign(sorted);
+    }
+
+    // Bulk load of knots already sorted by x, nodes are left half full
+    void assign(const std::vector<curve_point> &sorted)
+    {
+        clear();
+        if(sorted.empty()) return;
+        std::vector<node_ptr> level;
+        for(size_t i = 0; i < sorted.size(); i += leaf_size / 2)
+        {
+            auto n = std::make_shared<node>();
+            n->knots.assign(sorted.begin() + i, sorted.begin() + std::min(sorted.size(), i + leaf_size / 2));
+            n->refresh();
+            level.push_back(n);
+        }
+        while(level.size() > 1)
+        {
+            std::vector<node_ptr> upper;
+            for(size_t i = 0; i < level.size(); i += fanout / 2)
+            {
+                auto n = std::make_shared<node>();
+                n->children.assign(level.begin() + i, level.begin() + std::min(level.size(), i + fanout / 2));
+                n->refresh();
+                upper.push_back(n);
+            }
+            level.swap(upper);
+        }
+        root = level.front();
+        count = sorted.size();
+    }
+
+    void clear()
+    {
+        root.reset();
+        count = 0;
+    }
+
+    size_t size() const {return count;}
+    bool empty() const {return count == 0;}
+
+    const curve_point &operator[](size_t i) const
+    {
+        size_t local;
+        return leaf_of(i, local)->knots[local];
+    }
+
+    const curve_point &front() const {return (*this)[0];}
+    const curve_point &back() const {return (*this)[count - 1];}
+
+    const_iterator begin() const {return const_iterator(this, 0);}
+    const_iterator end() const {return const_iterator(this, count);}
+
+    // Iterator on knot i
+    const_iterator iterator_at(size_t i) const {return const_iterator(this, std::min(i, count));}
+
+    // Index of the first knot with x >= xval
+    size_t lower_bound(float xval) const
+    {
+        return bound(xval, false);
+    }
+
+    // Index of the first knot with x > xval
+    size_t upper_bound(float xval) const
+    {
+        return bound(xval, true);
+    }
+
+    // Inserts after the knots with the same x, returns the new index
+    size_t insert(const curve_point &p)
+    {
+        size_t at = 0;
+        if(!root) {
+            auto n = std::make_shared<node>();
+            n->knots.push_back(p);
+            n->refresh();
+            root = n;
+        } else {
+            node_ptr split;
+            node_ptr r = insert_into(root, p, at, split);
+            if(split) {
+                auto n = std::make_shared<node>();
+                n->children = {r, split};
+                n->refresh();
+                r = n;
+            }
+            root = r;
+        }
+        count++;
+        return at;
+    }
+
+    void erase(size_t i)
+    {
+        root = erase_from(root, i);
+        while(root && !root->leaf() && root->children.size() == 1)
+            root = root->children.front();
+        count--;
+    }
+
+    // Moves knot i to (xval, yval) wherever it lands in the order,
+    // returns its new index
+    size_t move(size_t i, float xval, float yval)
+    {
+        const bool after_prev = (i == 0) || (*this)[i - 1].x <= xval;
+        const bool before_next = (i + 1 == count) || (*this)[i + 1].x >= xval;
+        curve_point p = (*this)[i];
+        p.x = xval;
+        p.y = yval;
+        if(after_prev && before_next) {
+            root = update(root, i, p);
+            return i;
+        }
+        erase(i);
+        return insert(p);
+    }
+
+    void set_curve(size_t i, float curve)
+    {
+        curve_point p = (*this)[i];
+        p.curve = curve;
+        root = update(root, i, p);
+    }
+
+private:
+
+    const node *leaf_of(size_t i, size_t &local) const
+    {
+        const node *n = root.get();
+        while(!n->leaf())
+        {
+            size_t c = 0;
+            while(i >= n->children[c]->count)
+            {
+                i -= n->children[c]->count;
+                c++;
+            }
+            n = n->children[c].get();
+        }
+        local = i;
+        return n;
+    }
+
+    // Last child whose first x is before xval (or not after, for upper), or 0
+    static size_t child_for(const node *n, float xval, bool upper)
+    {
+        size_t c = 0;
+        for(size_t k = 1; k < n->children.size(); k++)
+        {
+            const float m = n->children[k]->min_x;
+            if(upper ? (m <= xval) : (m < xval)) c = k;
+            else break;
+        }
+        return c;
+    }
+
+    size_t bound(float xval, bool upper) const
+    {
+        if(!root) return 0;
+        size_t index = 0;
+        const node *n = root.get();
+        while(!n->leaf())
+        {
+            const size_t c = child_for(n, xval, upper);
+            for(size_t k = 0; k < c; k++) index += n->children[k]->count;
+            n = n->children[c].get();
+        }
+        auto it = upper
+                ? std::upper_bound(n->knots.begin(), n->knots.end(), xval,
+                                   [](float v, const curve_point &p) {return v < p.x;})
+                : std::lower_bound(n->knots.begin(), n->knots.end(), xval,
+                                   [](const curve_point &p, float v) {return p.x < v;});
+        return index + size_t(it - n->knots.begin());
+    }
+
+    // Moves the upper half of an overflowing node into a new node
+    static node_ptr split_node(node &n)
+    {
+        auto upper = std::make_shared<node>();
+        if(n.leaf()) {
+            const size_t half = n.knots.size() / 2;
+            upper->knots.assign(n.knots.begin() + half, n.knots.end());
+            n.knots.resize(half);
+        } else {
+            const size_t half = n.children.size() / 2;
+            upper->children.assign(n.children.begin() + half, n.children.end());
+            n.children.resize(half);
+        }
+        n.refresh();
+        upper->refresh();
+        return upper;
+    }
+
+    static node_ptr insert_into(const node_ptr &n, const curve_point &p, size_t &at, node_ptr &split)
+    {
+        auto copy = std::make_shared<node>(*n);
+        if(copy->leaf()) {
+            auto it = std::upper_bound(copy->knots.begin(), copy->knots.end(), p.x,
+                                       [](float v, const curve_point &q) {return v < q.x;});
+            at += size_t(it - copy->knots.begin());
+            copy->knots.insert(it, p);
+        } else {
+            const size_t c = child_for(copy.get(), p.x, true);
+            for(size_t k = 0; k < c; k++) at += copy->children[k]->count;
+            node_ptr child_split;
+            copy->children[c] = insert_into(copy->children[c], p, at, child_split);
+            if(child_split) copy->children.insert(copy->children.begin() + c + 1, child_split);
+        }
+        copy->refresh();
+        split = (copy->width() > (copy->leaf() ? leaf_size : fanout)) ? split_node(*copy) : nullptr;
+        return copy;
+    }
+
+    // Returns nullptr once the node is empty. Small neighbouring leaves are merged.
+    static node_ptr erase_from(const node_ptr &n, size_t i)
+    {
+        if(n->leaf()) {
+            if(n->knots.size() == 1) return nullptr;
+            auto copy = std::make_shared<node>(*n);
+            copy->knots.erase(copy->knots.begin() + i);
+            copy->refresh();
+            return copy;
+        }
+        auto copy = std::make_shared<node>(*n);
+        size_t c = 0;
+        while(i >= copy->children[c]->count)
+        {
+            i -= copy->children[c]->count;
+            c++;
+        }
+        node_ptr child = erase_from(copy->children[c], i);
+        if(!child) {
+            copy->children.erase(copy->children.begin() + c);
+            if(copy->children.empty()) return nullptr;
+        } else {
+            copy->children[c] = child;
+            if(child->leaf() && c + 1 < copy->children.size() && copy->children[c + 1]->leaf() &&
+                    child->knots.size() + copy->children[c + 1]->knots.size() <= leaf_size / 2) {
+                auto merged = std::make_shared<node>(*child);
+                const auto &next = copy->children[c + 1]->knots;
+                merged->knots.insert(merged->knots.end(), next.begin(), next.end());
+                merged->refresh();
+                copy->children[c] = merged;
+                copy->children.erase(copy->children.begin() + c + 1);
+            }
+        }
+        copy->refresh();
+        return copy;
+    }
+
+    // Replaces knot i, which must keep its place in the order
+    static node_ptr update(const node_ptr &n, size_t i, const curve_point &p)
+    {
+        auto copy = std::make_shared<node>(*n);
+        if(copy->leaf()) {
+            copy->knots[i] = p;
+        } else {
+            size_t c = 0;
+            while(i >= copy->children[c]->count)
+            {
+                i -= copy->children[c]->count;
+                c++;
+            }
+            copy->children[c] = update(copy->children[c], i, p);
+        }
+        copy->refresh();
+        return copy;
+    }
+
+    node_ptr root;
+    size_t count = 0;
+};
+
+}
+
+#endif // KNOT_LIST_H
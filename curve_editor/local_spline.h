@@ -0,0 +1,212 @@
+#ifndef LOCAL_SPLINE_H
+#define LOCAL_SPLINE_H
+
+#include<vector>
+#include<algorithm>
+#include<math.h>
+#include"curve_point.h"
+
+using namespace std;
+
+namespace curves {
+
+inline bool is_local_spline(curve_mode m)
+{
+    return m == curve_mode::monotone_cubic || m == curve_mode::akima || m == curve_mode::catmull_rom;
+}
+
+// Cubic Hermite interpolation of the knots, with a tangent at every knot
+// computed from its neighbours only :
+//   monotone_cubic  Fritsch-Butland weighted harmonic mean of the adjacent
+//                   slopes, zero at extrema, so monotone data never overshoots
+//   akima           Akima's weighting of the two slopes on each side
+//   catmull_rom     direction of the centripetal Catmull-Rom curve at the knot
+// Tangent k depends on knots k - 2 .. k + 2 at most, so moving a knot
+// changes a constant number of segments, see update_point().
+template<typename T>
+class local_spline
+{
+public:
+
+    template<typename Points>
+    void build(const Points &p, curve_mode m)
+    {
+        mode = m;
+        const int n = int(p.size());
+        x.resize(n);
+        y.resize(n);
+        int i = 0;
+        for(auto & it : p)
+        {
+            x[i] = it.x;
+            y[i] = it.y;
+            i++;
+        }
+        const int n_segments = std::max(0, n - 1);
+        slope.resize(n_segments);
+        tangent.resize(n);
+        a.resize(n_segments);
+        b.resize(n_segments);
+        c.resize(n_segments);
+        d.resize(n_segments);
+        if(n < 2) {
+            dirty_first = dirty_last = 0;
+            return;
+        }
+        update_range(0, n_segments, 0, n, 0, n_segments);
+    }
+
+    // Knot k moved without changing the knot order : recomputes the two
+    // slopes, five tangents and six segments around it.
+    // Falls back to a full rebuild when the knot count changed.
+    template<typename Points>
+    void update_point(const Points &p, int k)
+    {
+        const int n = int(p.size());
+        if(n != int(x.size()) || n < 2 || k < 0 || k >= n) {
+            build(p, mode);
+            return;
+        }
+        x[k] = p[k].x;
+        y[k] = p[k].y;
+        update_range(k - 1, k + 1, k - 2, k + 3, k - 3, k + 3);
+    }
+
+    curve_mode built_mode() const {return mode;}
+
+    // Segment i goes from knot_x(i) to knot_x(i + 1)
+    int segments() const {return int(a.size());}
+    T knot_x(int i) const {return x[i];}
+
+    T segment_value(int i, T xval) const
+    {
+        const T t = xval - x[i];
+        return ((a[i] * t + b[i]) * t + c[i]) * t + d[i];
+    }
+
+    // Segment i is ((ca * t + cb) * t + cc) * t + cd, with t = x - knot_x(i)
+    void coefficients(int i, T &ca, T &cb, T &cc, T &cd) const
+    {
+        ca = a[i];
+        cb = b[i];
+        cc = c[i];
+        cd = d[i];
+    }
+
+    // Segments rewritten by the last build or update
+    int dirty_begin() const {return dirty_first;}
+    int dirty_end() const {return dirty_last;}
+
+    // Evaluates the curve at x = j * step for j in [0, size),
+    // holding the end knot values outside of the knot range
+    void sample(T *out, int size, T step) const
+    {
+        const int n = segments();
+        int j = 0;
+        for(; j < size && T(j) * step < x[0]; j++)
+            out[j] = y[0];
+        for(int i = 0; i < n && j < size; i++)
+        {
+            int last = j;
+            while(last < size && (T(last) * step < x[i + 1] || (i == n - 1 && T(last) * step <= x[n])))
+                last++;
+            const T ca = a[i], cb = b[i], cc = c[i], cd = d[i], x_i = x[i];
+            for(; j < last; j++)
+            {
+                const T t = T(j) * step - x_i;
+                out[j] = ((ca * t + cb) * t + cc) * t + cd;
+            }
+        }
+        for(; j < size; j++)
+            out[j] = y[n];
+    }
+
+private:
+
+    // Recomputes slopes [s0, s1), tangents [t0, t1) and segments [c0, c1),
+    // each range clamped to the curve
+    void update_range(int s0, int s1, int t0, int t1, int c0, int c1)
+    {
+        const int n = int(x.size()), n_segments = n - 1;
+        for(int i = std::max(0, s0); i < std::min(n_segments, s1); i++)
+        {
+            const T h = x[i + 1] - x[i];
+            slope[i] = (h > 0) ? (y[i + 1] - y[i]) / h : T(0);
+        }
+        for(int i = std::max(0, t0); i < std::min(n, t1); i++)
+            tangent[i] = knot_tangent(i);
+        dirty_first = std::max(0, c0);
+        dirty_last = std::min(n_segments, c1);
+        for(int i = dirty_first; i < dirty_last; i++)
+        {
+            const T h = x[i + 1] - x[i];
+            d[i] = y[i];
+            if(h <= 0) {
+                a[i] = b[i] = c[i] = 0;
+                continue;
+            }
+            c[i] = tangent[i];
+            b[i] = (T(3) * slope[i] - T(2) * tangent[i] - tangent[i + 1]) / h;
+            a[i] = (tangent[i] + tangent[i + 1] - T(2) * slope[i]) / (h * h);
+        }
+    }
+
+    // Slope of segment i, extended past the ends by linear extrapolation
+    // of the slopes as Akima does
+    T slope_at(int i) const
+    {
+        const int n_segments = int(slope.size());
+        if(n_segments == 1) return slope[0];
+        if(i < 0) return slope_at(i + 1) * T(2) - slope_at(i + 2);
+        if(i >= n_segments) return slope_at(i - 1) * T(2) - slope_at(i - 2);
+        return slope[i];
+    }
+
+    T knot_tangent(int k) const
+    {
+        const int n = int(x.size());
+        switch(mode)
+        {
+        case curve_mode::akima:
+        {
+            const T m0 = slope_at(k - 2), m1 = slope_at(k - 1), m2 = slope_at(k), m3 = slope_at(k + 1);
+            const T w_left = std::abs(m3 - m2), w_right = std::abs(m1 - m0);
+            if(w_left + w_right <= T(1e-9)) return (m1 + m2) / T(2);
+            return (w_left * m1 + w_right * m2) / (w_left + w_right);
+        }
+        case curve_mode::catmull_rom:
+        {
+            // end knots get a phantom neighbour mirrored through them
+            const T px = (k > 0) ? x[k - 1] : T(2) * x[0] - x[1];
+            const T py = (k > 0) ? y[k - 1] : T(2) * y[0] - y[1];
+            const T nx = (k < n - 1) ? x[k + 1] : T(2) * x[n - 1] - x[n - 2];
+            const T ny = (k < n - 1) ? y[k + 1] : T(2) * y[n - 1] - y[n - 2];
+            // centripetal parametrization : intervals are square roots of the chord lengths
+            const T d01 = sqrt(sqrt((x[k] - px) * (x[k] - px) + (y[k] - py) * (y[k] - py)));
+            const T d12 = sqrt(sqrt((nx - x[k]) * (nx - x[k]) + (ny - y[k]) * (ny - y[k])));
+            if(d01 <= 0 || d12 <= 0) return T(0);
+            const T tx = (x[k] - px) / d01 - (nx - px) / (d01 + d12) + (nx - x[k]) / d12;
+            const T ty = (y[k] - py) / d01 - (ny - py) / (d01 + d12) + (ny - y[k]) / d12;
+            return (tx > 0) ? ty / tx : T(0);
+        }
+        default:
+        {
+            if(k == 0) return slope[0];
+            if(k == n - 1) return slope[n - 2];
+            const T s0 = slope[k - 1], s1 = slope[k];
+            if(s0 * s1 <= 0) return T(0);
+            const T h0 = x[k] - x[k - 1], h1 = x[k + 1] - x[k];
+            const T w0 = T(2) * h1 + h0, w1 = h1 + T(2) * h0;
+            return (w0 + w1) / (w0 / s0 + w1 / s1);
+        }
+        }
+    }
+
+    curve_mode mode = curve_mode::monotone_cubic;
+    int dirty_first = 0, dirty_last = 0;
+    vector<T> x, y, slope, tangent, a, b, c, d;
+};
+
+}
+
+#endif // LOCAL_SPLINE_H
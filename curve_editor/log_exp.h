@@ -0,0 +1,107 @@
+#ifndef LOG_EXP_H
+#define LOG_EXP_H
+
+#include<math.h>
+#include<algorithm>
+
+namespace curves {
+
+// One log/exp segment going from `beg` to `ending` in `dur` steps :
+//   value(idx) = beg + (ending - beg) * (1 - exp(idx * type / (dur - 1))) / (1 - exp(type))
+// which is offset - scale * r^idx, with r = exp(type / (dur - 1)).
+// render() produces successive values with that geometric recurrence, and
+// recomputes r^idx with exp() every resync_period steps to bound the error.
+// A zero type gives a straight line.
+template<typename T>
+class log_exp_segment
+{
+public:
+
+    constexpr static const int resync_period = 64;
+
+    log_exp_segment(T beg, T ending, int dur, T typ) :
+        beg_(beg), dur_(dur)
+    {
+        if(typ == 0) {
+            linear = true;
+            range = ending - beg;
+            step = (dur > 0) ? (ending - beg) / T(dur) : T(0);
+            return;
+        }
+        type_ = std::clamp(double(typ), -10.0, 10.0);
+        k = (dur > 1) ? type_ / double(dur - 1) : 0.0;
+        ratio = exp(k);
+        scale = (double(ending) - double(beg)) / (1.0 - exp(type_));
+        offset = double(beg) + scale;
+    }
+
+    T value(int idx) const
+    {
+        if(linear) return beg_ + T(idx) * step;
+        return T(offset - scale * exp(double(idx) * k));
+    }
+
+    // Writes value(first) .. value(first + n - 1) to out
+    void render(T *out, int n, int first = 0) const
+    {
+        if(linear) {
+            for(int i = 0; i < n; i++)
+                out[i] = beg_ + T(first + i) * step;
+            return;
+        }
+        int i = 0;
+        while(i < n)
+        {
+            double e = exp(double(first + i) * k);
+            const int end = std::min(n, i + resync_period);
+            for(; i < end; i++)
+            {
+                out[i] = T(offset - scale * e);
+                e *= ratio;
+            }
+        }
+    }
+
+    // Same curve, written at the normalized positions u = u0 + i * du, u going
+    // from 0 at `beg` to 1 at `ending`. Used to resample a segment on any grid.
+    void render_at(T *out, int n, double u0, double du) const
+    {
+        if(linear) {
+            for(int i = 0; i < n; i++)
+                out[i] = beg_ + T(u0 + i * du) * range;
+            return;
+        }
+        const double r = exp(type_ * du);
+        int i = 0;
+        while(i < n)
+        {
+            double e = exp(type_ * (u0 + i * du));
+            const int end = std::min(n, i + resync_period);
+            for(; i < end; i++)
+            {
+                out[i] = T(offset - scale * e);
+                e *= r;
+            }
+        }
+    }
+
+    // Value at the normalized position u, 0 at `beg` and 1 at `ending`
+    T at(double u) const
+    {
+        if(linear) return beg_ + T(u) * range;
+        return T(offset - scale * exp(type_ * u));
+    }
+
+    int duration() const {return dur_;}
+
+private:
+    T beg_;
+    int dur_;
+    bool linear = false;
+    T step = 0, range = 0;
+    double type_ = 0, k = 0, ratio = 1, scale = 0, offset = 0;
+};
+
+}
+
+#endif // LOG_EXP_H
@@ -7,7 +7,18 @@
 #include<iostream>
 #include<chrono>
 #include"spline.h"
+#include"local_spline.h"
+#include"log_exp.h"
+#include"curve_publisher.h"
 #include"curve_point.h"
+#include"knot_list.h"
+#include"knot_index.h"
+#include"flatten.h"
+#include"stroke_simplifier.h"
+#include"edit_history.h"
+#include"curve_library.h"
+#include"curve_lane.h"
+#include"curve_batch.h"
 
 using namespace cycfi::elements;
 using namespace cycfi::artist;
@@ -16,15 +27,6 @@ using namespace cycfi::artist;
 auto constexpr bkd_color = rgba(35, 35, 37, 255);
 auto background = box(bkd_color);
 
-
-enum curve_mode {
-        linear = 0,
-        log_exp = 1,
-        quadratic_bezier = 2,
-        cubic_bezier = 3,
-        cubic_spline = 4,
-};
-
 struct custom_radio_button_element : element, basic_receiver<button_state>
 {
 
@@ -94,192 +96,471 @@ struct curve_editor_style
 
 };
 
+
 class curve_editor : public tracker<>, receiver<curve_editor_controller>
 {
 public:
 
     constexpr static const  float selection_distance = 0.02f;
-
-
-
-    curve_editor() : grid_steps(10), granularity(2048), mode(curve_mode::linear)
+    constexpr static const char *library_path = "curves.crvl";
+    // maximum distance in pixels between a drawn curve and its polyline
+    constexpr static const  float flatten_tolerance = 0.25f;
+    // maximum vertical distance in pixels between a freehand stroke and its knots
+    constexpr static const  float freehand_tolerance = 1.0f;
+    // lanes share the height down to this, then the lanes scroll
+    constexpr static const  float min_lane_height = 80.0f;
+    constexpr static const  float lane_gap = 4.0f;
+    // drags and hovers repaint at most once per frame_interval
+    constexpr static const std::chrono::milliseconds frame_interval{16};
+    // half size in pixels of a knot marker, focus ring included, plus the line width
+    constexpr static const  float marker_margin = 12.0f;
+
+
+
+    curve_editor() : grid_steps(10), granularity(2048)
     {
+        add_lane();
     }
 
     float get_curve(float beg, float ending, int dur, int idx, float typ)
     {
-      double res;
-      double type;
-      if(typ == 0) {
-        res = beg + (idx * (( ending - beg) / dur));
-      }else {
-        if(typ > 10) type = 10;
-        else if(typ <  -10) type = -10;
-        else type = typ;
-        res = beg + (ending - beg) * (1 - exp(idx * type / (dur - 1))) / (1-exp(type));
-      }
-      return res;
+        return curves::log_exp_segment<float>(beg, ending, dur, typ).value(idx);
     }
 
 
 
+    bool wants_focus() const override
+    {
+        return true;
+    }
+
     bool key(const context &ctx, key_info k) override
     {
+        // scroll events carry no modifiers
+        if(k.key == key_code::left_control || k.key == key_code::right_control) {
+            control_down = (k.action != key_action::release);
+            return true;
+        }
+        if(k.action == key_action::release || !(k.modifiers & mod_control)) return false;
+        if(k.key == key_code::z && (k.modifiers & mod_shift)) return undo_redo(ctx, false);
+        if(k.key == key_code::z) return undo_redo(ctx, true);
+        if(k.key == key_code::y) return undo_redo(ctx, false);
+        if(k.key == key_code::s) {
+            if(!save_library()) cerr << "curve_editor : could not save " << library_path << endl;
+            return true;
+        }
+        if(k.key == key_code::o) {
+            if(!open_library(ctx)) cerr << "curve_editor : could not open " << library_path << endl;
+            return true;
+        }
+        if(k.key == key_code::f) {
+            freehand = !freehand;
+            return true;
+        }
+        if(k.key == key_code::n) {
+            add_lane();
+            select_lane(ctx, lanes.size() - 1);
+            return true;
+        }
+        if(k.key == key_code::up && active_lane > 0) {
+            select_lane(ctx, active_lane - 1);
+            return true;
+        }
+        if(k.key == key_code::down && active_lane + 1 < lanes.size()) {
+            select_lane(ctx, active_lane + 1);
+            return true;
+        }
         return false;
     }
 
-    int find_sample(point &p, const context &ctx)
+    void add_lane()
     {
-        auto size = ctx.bounds.size();
-        auto pos = ctx.bounds.top_left();
-        const point relative( (p.x - pos.x) / size.x, (p.y - pos.y) / size.y);
+        lanes.push_back(std::make_unique<curves::curve_lane>());
+    }
+
+    curves::curve_lane &active()
+    {
+        return *lanes[active_lane];
+    }
+
+    // Makes lane i the edited one and scrolls it into view
+    void select_lane(const context &ctx, size_t i)
+    {
+        if(i != active_lane) {
+            commit_edit();
+            close_edit();
+            active_lane = i;
+            selected = -1;
+            focused = -1;
+        }
+        const size_t in_view = std::max(size_t(1), size_t(ctx.bounds.height() / lane_height(ctx)));
+        if(active_lane < first_lane) first_lane = active_lane;
+        else if(active_lane >= first_lane + in_view) first_lane = active_lane + 1 - in_view;
+        ctx.view.refresh();
+    }
+
+    float lane_height(const context &ctx) const
+    {
+        return std::max(min_lane_height, ctx.bounds.height() / float(lanes.size()));
+    }
+
+    // Lanes [first_lane, end) intersect the bounds
+    size_t lanes_end(const context &ctx) const
+    {
+        const size_t in_view = size_t(ceil(ctx.bounds.height() / lane_height(ctx)));
+        return std::min(lanes.size(), first_lane + in_view);
+    }
+
+    // Context of lane i, its bounds being the lane strip
+    context lane_context(const context &ctx, size_t i) const
+    {
+        const float h = lane_height(ctx);
+        const float top = ctx.bounds.top + float(i - first_lane) * h;
+        return context(ctx, rect(ctx.bounds.left, top, ctx.bounds.right,
+                                 std::min(top + h - lane_gap, ctx.bounds.bottom)));
+    }
+
+    // Lane under p, or -1
+    int lane_at(const context &ctx, const point &p) const
+    {
+        const float row = floor((p.y - ctx.bounds.top) / lane_height(ctx));
+        if(row < 0) return -1;
+        const size_t i = first_lane + size_t(row);
+        return (i < lanes_end(ctx)) ? int(i) : -1;
+    }
 
-        for(size_t i = 0; i < samples.size(); i++) {
-            const float distance = samples[i].distance_to(relative);
-            if(distance < selection_distance) {
-                return i;
+    // Input events only update the model and merge the area they changed in
+    // dirty_area : one refresh of that area is posted per frame, however many
+    // events arrive meanwhile, and the curves are rebuilt by that repaint only.
+    // An edit leaving commit_pending set is published by that same frame.
+    void invalidate(const context &ctx, const rect &area)
+    {
+        dirty_area = frame_pending ? union_(dirty_area, area) : area;
+        if(frame_pending) return;
+        frame_pending = true;
+        view &v = ctx.view;
+        v.post(frame_interval, [this, &v]() {
+            frame_pending = false;
+            if(commit_pending) {
+                commit_pending = false;
+                commit_edit();
             }
+            v.refresh(dirty_area);
+        });
+    }
+
+    // Lane strip between the relative abscissas x0 and x1, knot markers included
+    rect x_area(const context &ctx, float x0, float x1) const
+    {
+        const float left = to_screen(ctx, point(std::min(x0, x1), 0)).x - marker_margin;
+        const float right = to_screen(ctx, point(std::max(x0, x1), 0)).x + marker_margin;
+        return rect(std::max(left, ctx.bounds.left), ctx.bounds.top,
+                    std::min(right, ctx.bounds.right), ctx.bounds.bottom);
+    }
+
+    // Area whose drawing depends on knot i : the segments it shapes and their
+    // markers, over the lane height since segments may overshoot
+    rect knot_area(const context &ctx, const curves::curve_lane &lane, size_t i) const
+    {
+        size_t reach = 1;
+        switch(lane.mode)
+        {
+        case curve_mode::cubic_spline:
+            return ctx.bounds;
+        case curve_mode::monotone_cubic:
+        case curve_mode::akima:
+        case curve_mode::catmull_rom:
+        case curve_mode::cubic_bezier:
+            reach = 3;
+            break;
+        case curve_mode::quadratic_bezier:
+            reach = 2;
+            break;
+        default:
+            break;
         }
-        return -1;
+        const size_t first = (i > reach) ? i - reach : 0;
+        const size_t last = std::min(lane.samples.size() - 1, i + reach);
+        return x_area(ctx, lane.samples[first].x, lane.samples[last].x);
     }
 
-    void add_sample(point &p, const context &ctx)
+    rect marker_area(const context &ctx, const point &relative) const
     {
-        auto pos = ctx.bounds.top_left();
-        auto size = ctx.bounds.size();
-        curve_point cp( (p.x - pos.x) / size.x ,  (p.y - pos.y) / size.y , 0.0);
-        if(samples.empty()) {
-            samples.push_back(cp);
-            selected = 0;
-            return;
+        const point p = to_screen(ctx, relative);
+        return rect(p.x - marker_margin, p.y - marker_margin, p.x + marker_margin, p.y + marker_margin);
+    }
+
+    // Freehand strokes replace the knots in the x range they sweep. Raw
+    // positions go through the simplifier, only the knots it fixes reach samples.
+    void begin_stroke(const context &ctx, const point &p)
+    {
+        curves::curve_lane &lane = active();
+        const point relative = to_relative(ctx, p);
+        begin_edit();
+        stroking = true;
+        selected = -1;
+        focused = -1;
+        stroke.begin(relative, freehand_tolerance / ctx.bounds.height());
+        size_t at = curves::knot_index::lower_bound_x(lane.samples, relative.x);
+        while(at < lane.samples.size() && lane.samples[at].x == relative.x) lane.samples.erase(at);
+        lane.samples.insert(curve_point(relative.x, relative.y, 0.0f));
+        lane.moved_sample = -2;
+        lane.samples_version++;
+    }
+
+    void extend_stroke(const context &ctx, const point &p)
+    {
+        curves::curve_lane &lane = active();
+        point knot;
+        const bool fixed = stroke.add(to_relative(ctx, p), knot);
+        if(stroke.direction() == 0) return;
+        // old knots between the last stroke knot and the pen
+        const float from = stroke.anchor().x, to = stroke.end().x;
+        bool changed = false;
+        if(stroke.direction() > 0) {
+            const size_t at = curves::knot_index::upper_bound_x(lane.samples, from);
+            while(at < lane.samples.size() && lane.samples[at].x <= to) {
+                lane.samples.erase(at);
+                changed = true;
+            }
+        } else {
+            size_t at = curves::knot_index::lower_bound_x(lane.samples, to);
+            while(at < lane.samples.size() && lane.samples[at].x < from) {
+                lane.samples.erase(at);
+                changed = true;
+            }
         }
-        if(samples[0].x > cp.x) {
-            samples.insert(samples.begin(), cp);
-            selected = 0;
-            return;
+        if(fixed) {
+            lane.samples.insert(curve_point(knot.x, knot.y, 0.0f));
+            changed = true;
         }
-
-        if(samples.back().x < cp.x) {
-            samples.push_back(cp);
-            selected = samples.size() - 1;
-            return;
+        if(changed) {
+            lane.moved_sample = -2;
+            lane.samples_version++;
         }
-        for(size_t i = 0; i < samples.size() - 1; i++) {
-            if( samples[i].x < cp.x && samples[i+1].x > cp.x)
-            {
-                samples.insert(samples.begin() + i + 1, cp);
-                selected = i + 1;
-                return;
-            }
+    }
+
+    void end_stroke()
+    {
+        curves::curve_lane &lane = active();
+        point knot;
+        if(stroke.finish(knot)) {
+            lane.samples.insert(curve_point(knot.x, knot.y, 0.0f));
+            lane.moved_sample = -2;
+            lane.samples_version++;
         }
+        stroking = false;
+        close_edit();
     }
 
-    void draw_segments(const context &ctx)
+    // Pending part of the stroke, from its last knot to the pen
+    void draw_stroke(const context &ctx)
     {
-        if(samples.empty()) return;
+        if(!stroking) return;
         canvas &cnv = ctx.canvas;
-        auto size = ctx.bounds.size();
-        auto pos = ctx.bounds.top_left();
         cnv.stroke_color(colors::purple);
         cnv.line_width(1.5);
-        switch(mode)
-        {
-        case curve_mode::linear:
-        {
-            for(size_t i = 0; i < samples.size() - 1; i++) {
+        cnv.move_to(to_screen(ctx, stroke.anchor()));
+        cnv.line_to(to_screen(ctx, stroke.end()));
+        cnv.stroke();
+    }
 
-                if(i == 0 ) {
-                    const point p(samples[i].x * size.x + pos.x, samples[i].y * size.y + pos.y);
-                    cnv.move_to(p);
-                }
-                const point p2(samples[i + 1].x * size.x + pos.x, samples[i + 1].y * size.y + pos.y);
-                cnv.line_to(p2);
-            }
+    // One library curve per lane
+    bool save_library()
+    {
+        curves::curve_library_writer writer;
+        if(!writer.open(library_path)) return false;
+        for(size_t i = 0; i < lanes.size(); i++)
+            writer.add("lane " + std::to_string(i + 1), lanes[i]->mode, lanes[i]->samples);
+        return writer.close();
+    }
 
-            cnv.stroke();
-            break;
-        }
-        case curve_mode::log_exp:
+    // Replaces the samples of lane i with curve i of the library, adding lanes
+    // as needed. Each replaced lane gets one undoable edit.
+    // Every curve is decoded and checked first, so a bad library changes nothing.
+    bool open_library(const context &ctx)
+    {
+        curves::curve_library library;
+        if(!library.open(library_path) || library.size() == 0) return false;
+        vector< vector<curve_point> > decoded(library.size());
+        vector<curve_mode> modes(library.size());
+        for(size_t i = 0; i < library.size(); i++)
         {
-
-            const point origin(samples[0].x * size.x + pos.x, samples[0].y * size.y + pos.y);
-            cnv.move_to(origin);
-            for(size_t i = 0; i < samples.size() - 1; i++) {
-                if(samples[i].curve == 0.0f) {
-                    const point p2(samples[i + 1].x * size.x + pos.x, samples[i + 1].y * size.y + pos.y);
-                    cnv.line_to(p2);
-                } else {
-                    const float granularized_begx = samples[i].x * granularity;
-                    const float granularized_fbx = samples[i + 1].x * granularity;
-                    const float amp_x = abs(granularized_begx - granularized_fbx);
-                    for(int l_idx = 0; l_idx < int(amp_x); l_idx++ ) {
-                        const float curve =  (samples[i].y > samples[i + 1].y) ? -samples[i].curve :  samples[i].curve;
-                        const float y_val = get_curve(samples[i].y, samples[i + 1].y, int(amp_x), l_idx, curve) * size.y + pos.y;
-                        const float x_val = ((l_idx + granularized_begx) / granularity) * size.x + pos.x;
-                        const point p2(x_val, y_val);
-                        cnv.line_to(p2);
-                    }
-                }
+            vector<curve_point> &knots = decoded[i];
+            if(!library.load(i, knots) || !library.mode(i, modes[i])) return false;
+            for(auto & it : knots)
+            {
+                if(!std::isfinite(it.x) || !std::isfinite(it.y) || !std::isfinite(it.curve)) return false;
             }
-            cnv.stroke();
-            break;
+            std::stable_sort(knots.begin(), knots.end(),
+                             [](const curve_point &a, const curve_point &b) {return a.x < b.x;});
+            // knots sharing an x would give the spline empty segments, the first one is kept
+            knots.erase(std::unique(knots.begin(), knots.end(),
+                                    [](const curve_point &a, const curve_point &b) {return a.x == b.x;}),
+                        knots.end());
         }
-        case curve_mode::cubic_spline:
+
+        commit_edit();
+        close_edit();
+        for(size_t i = 0; i < decoded.size(); i++)
         {
-            if(samples.size() < 3) return;
-            const float step = 1.0f / float(granularity) * size.x;
-            vector<float> &vec = spline.interpolate_from_points(samples, granularity, size);
+            if(i == lanes.size()) add_lane();
+            curves::curve_lane &lane = *lanes[i];
+            lane.history.record(lane.samples);
+            lane.samples.assign(decoded[i]);
+            lane.mode = modes[i];
+            lane.samples_version++;
+            lane.moved_sample = -2;
+            publish(lane);
+        }
+        selected = -1;
+        focused = -1;
+        ctx.view.refresh();
+        return true;
+    }
 
+    // Saves the samples before the first change of an edit : the following
+    // changes until the edit is closed (a drag until release) make one step
+    void begin_edit()
+    {
+        if(edit_open) return;
+        active().history.record(active().samples);
+        edit_open = true;
+    }
 
-            point p1, p2;
-            const int start_x = int(samples.front().x * granularity) + 1;
-            const int end_x = int(samples.back().x *granularity) - 1;
+    void close_edit()
+    {
+        edit_open = false;
+        scrolled_segment = -1;
+    }
 
-            p1 = point( (float(start_x) / float(granularity) ) * size.x + pos.x, (vec[start_x] * size.y) + pos.y);
-            p1 = in_bounds(ctx, p1);
-            cnv.move_to(p1);
+    bool undo_redo(const context &ctx, bool undo)
+    {
+        curves::curve_lane &lane = active();
+        close_edit();
+        if(!(undo ? lane.history.undo(lane.samples) : lane.history.redo(lane.samples))) return true;
+        lane.samples_version++;
+        lane.moved_sample = -2;
+        selected = -1;
+        focused = -1;
+        commit_edit();
+        ctx.view.refresh();
+        return true;
+    }
 
-            for(int i = start_x; i < end_x; i++)
-            {
-                const float x_relative = float(i) / float(granularity);
-                const float x_absolute = ( x_relative )  * size.x + pos.x;
-                p2 = point(x_absolute + step, vec[i+1] * size.y + pos.y);
-                p2 = in_bounds(ctx, p2);
-                cnv.line_to(p2);
-            }
+    // Screen point to relative coordinates, through the visible x range
+    point to_relative(const context &ctx, const point &p) const
+    {
+        return point(view_first + (p.x - ctx.bounds.left) / ctx.bounds.width() * view_width,
+                     (p.y - ctx.bounds.top) / ctx.bounds.height());
+    }
+
+    point to_screen(const context &ctx, const point &p) const
+    {
+        return point(ctx.bounds.left + (p.x - view_first) / view_width * ctx.bounds.width(),
+                     ctx.bounds.top + p.y * ctx.bounds.height());
+    }
+
+    // Knots [first, last) within margin pixels of the visible x range, plus the
+    // knot on each side so that segments crossing the edges are included
+    void visible_knots(const context &ctx, const curves::curve_lane &lane, float margin,
+                       size_t &first, size_t &last) const
+    {
+        const float relative_margin = margin / ctx.bounds.width() * view_width;
+        lane.visible_knots(view_first - relative_margin, view_first + view_width + relative_margin,
+                           first, last);
+    }
+
+    int find_sample(point &p, const context &ctx)
+    {
+        curves::curve_lane &lane = active();
+        const point relative = to_relative(ctx, p);
+        return lane.knots_index.find_nearest(lane.samples, relative, selection_distance, lane.samples_version,
+                                             1.0f / view_width);
+    }
+
+    void add_sample(point &p, const context &ctx)
+    {
+        curves::curve_lane &lane = active();
+        const point relative = to_relative(ctx, p);
+        curve_point cp(relative.x, relative.y, 0.0);
+        // a knot with the same x is not duplicated
+        const size_t at = curves::knot_index::lower_bound_x(lane.samples, cp.x);
+        if(at < lane.samples.size() && lane.samples[at].x == cp.x) return;
+        begin_edit();
+        lane.moved_sample = -2;
+        lane.samples_version++;
+        selected = lane.samples.insert(cp);
+    }
+
+    // pixels per unit the curves are flattened for
+    point curve_scale(const context &ctx) const
+    {
+        return point(round(ctx.bounds.width() / view_width), round(ctx.bounds.height()));
+    }
+
+    // Repaints only reapply the screen transform unless the curve or the
+    // visible knots changed. Polylines are only stroked over `area`.
+    void draw_segments(const context &ctx, curves::curve_lane &lane, const rect &area)
+    {
+        if(lane.samples.empty()) return;
+        const point scale = curve_scale(ctx);
+        size_t first, last;
+        visible_knots(ctx, lane, 0, first, last);
+        if(!lane.cache_valid(scale, first, last))
+            lane.build_polyline(scale, first, last, flatten_tolerance);
+        const vector<point> &pts = lane.caches[lane.mode].points;
+        if(pts.empty()) return;
+
+        canvas &cnv = ctx.canvas;
+        auto to_screen = [&](const point &p) {
+            return this->to_screen(ctx, p);
+        };
+        // vertices and control points come sorted by x : [begin, end) covers the area
+        const float x0 = to_relative(ctx, point(area.left, 0)).x;
+        const float x1 = to_relative(ctx, point(area.right, 0)).x;
+        auto before = [](const point &p, float x) {return p.x < x;};
+        size_t begin = size_t(std::lower_bound(pts.begin(), pts.end(), x0, before) - pts.begin());
+        size_t end = size_t(std::lower_bound(pts.begin() + begin, pts.end(), x1, before) - pts.begin());
+        if(begin > 0) begin--;
+        end = std::min(end + 1, pts.size());
+
+        cnv.stroke_color(colors::purple);
+        cnv.line_width(1.5);
+        switch(lane.mode)
+        {
+        case curve_mode::linear:
+        case curve_mode::log_exp:
+        case curve_mode::cubic_spline:
+        case curve_mode::monotone_cubic:
+        case curve_mode::akima:
+        case curve_mode::catmull_rom:
+        {
+            if(end - begin < 2) return;
+            cnv.move_to(to_screen(pts[begin]));
+            for(size_t i = begin + 1; i < end; i++)
+                cnv.line_to(to_screen(pts[i]));
             cnv.stroke();
             break;
         }
-
         case curve_mode::cubic_bezier:
         {
-            if(samples.size() < 4) return;
-
-            const point p1(samples[0].x * size.x  + pos.x, samples[0].y * size.y + pos.y);
-            cnv.move_to(p1);
-
-            for(size_t i = 0; i < samples.size() - 3; i+=3) {
-                const point p2(samples[i + 1].x * size.x + pos.x, samples[i + 1].y * size.y + pos.y);
-                const point p3(samples[i + 2].x * size.x + pos.x, samples[i + 2].y * size.y + pos.y);
-                const point p4(samples[i + 3].x * size.x + pos.x, samples[i + 3].y * size.y + pos.y);
-                cnv.bezier_curve_to(p2, p3, p4);
-            }
-
+            // whole segments, pts starting on a segment
+            begin = (begin / 3) * 3;
+            if(pts.size() < 4) return;
+            cnv.move_to(to_screen(pts[begin]));
+            for(size_t i = begin; i < pts.size() - 3 && i < end; i+=3)
+                cnv.bezier_curve_to(to_screen(pts[i + 1]), to_screen(pts[i + 2]), to_screen(pts[i + 3]));
             cnv.stroke();
             break;
-
         }
         case curve_mode::quadratic_bezier:
         {
-            if(samples.size() < 3) return;
-
-            const point p1(samples[0].x * size.x + pos.x, samples[0].y * size.y + pos.y);
-            cnv.move_to(p1);
-            for(size_t i = 0; i < samples.size() - 2; i+=2) {
-                const point p2(samples[i + 1].x * size.x + pos.x, samples[i + 1].y * size.y + pos.y);
-                const point p3(samples[i + 2].x * size.x + pos.x, samples[i + 2].y * size.y + pos.y);
-                cnv.quadratic_curve_to(p2, p3);
-            }
+            begin = (begin / 2) * 2;
+            if(pts.size() < 3) return;
+            cnv.move_to(to_screen(pts[begin]));
+            for(size_t i = begin; i < pts.size() - 2 && i < end; i+=2)
+                cnv.quadratic_curve_to(to_screen(pts[i + 1]), to_screen(pts[i + 2]));
             cnv.stroke();
             break;
         }
@@ -288,26 +569,50 @@ public:
         }
     }
 
-    void draw_samples(const context &ctx)
+    // Selection and focus only show on the active lane.
+    // Only the markers over `area` are drawn.
+    void draw_samples(const context &ctx, const curves::curve_lane &lane, int selected_knot, int focused_knot,
+                      const rect &area)
     {
-        if(samples.empty()) return;
+        if(lane.samples.empty()) return;
         canvas& cnv = ctx.canvas;
-        auto size = ctx.bounds.size();
-        auto pos = ctx.bounds.top_left();
-
-        cnv.fill_color(colors::red.opacity(0.5));
-
-        for(int i = 0; i < int(samples.size()); i++)
+        size_t first, last;
+        lane.visible_knots(to_relative(ctx, point(std::max(area.left, ctx.bounds.left) - marker_margin, 0)).x,
+                           to_relative(ctx, point(std::min(area.right, ctx.bounds.right) + marker_margin, 0)).x,
+                           first, last);
+
+        // knots falling on an already covered pixel are skipped, the column
+        // being the x pixel and knots coming sorted by x
+        const int height = int(ctx.bounds.height()) + 1;
+        if(int(marked_rows.size()) < height) marked_rows.resize(height, -1);
+        std::fill(marked_rows.begin(), marked_rows.begin() + height, -1);
+
+        // one path for all the plain knots
+        auto it = lane.samples.iterator_at(first);
+        for(size_t i = first; i < last; i++, ++it)
         {
-            if(i == focused) {
-               cnv.fill_color(colors::red.opacity(0.2));
-               cnv.add_circle(samples[i].x * size.x + pos.x, samples[i].y * size.y + pos.y, 10);
-               cnv.fill();
-               cnv.fill_color(colors::red);
+            if(int(i) == selected_knot) continue;
+            const point p = to_screen(ctx, *it);
+            const int column = int(floor(p.x)), row = int(p.y - ctx.bounds.top);
+            if(row >= 0 && row < height) {
+                if(marked_rows[row] == column) continue;
+                marked_rows[row] = column;
             }
-            if(i == selected) cnv.fill_color(colors::salmon);
-            else cnv.fill_color(colors::red.opacity(0.7));
-            cnv.add_circle(samples[i].x * size.x + pos.x, samples[i].y * size.y + pos.y, 5);
+            cnv.add_circle(p.x, p.y, 5);
+        }
+        cnv.fill_color(colors::red.opacity(0.7));
+        cnv.fill();
+
+        if(focused_knot >= int(first) && focused_knot < int(last)) {
+            const point p = to_screen(ctx, lane.samples[focused_knot]);
+            cnv.fill_color(colors::red.opacity(0.2));
+            cnv.add_circle(p.x, p.y, 10);
+            cnv.fill();
+        }
+        if(selected_knot >= int(first) && selected_knot < int(last)) {
+            const point p = to_screen(ctx, lane.samples[selected_knot]);
+            cnv.fill_color(colors::salmon);
+            cnv.add_circle(p.x, p.y, 5);
             cnv.fill();
         }
     }
@@ -330,7 +635,8 @@ public:
             cnv.stroke();
 
 
-            const float x = (pos.x + (float(i / 10.0f) * size.x));
+            const float x = to_screen(ctx, point(float(i / 10.0f), 0)).x;
+            if(x < pos.x || x > pos.x + size.x) continue;
             p1 = point(x, pos.y);
             p2 = point(x, pos.y + size.y);
             p = path(rect(p1, p2)) ;
@@ -340,31 +646,95 @@ public:
         }
     }
 
+    // Keeps the visible x range inside [0, 1]
+    void set_view(float first, float width)
+    {
+        view_width = std::clamp(width, min_view_width, 1.0f);
+        view_first = std::clamp(first, 0.0f, 1.0f - view_width);
+    }
+
+    // control + scroll zooms around the cursor, horizontal scroll pans,
+    // vertical scroll curves the segment under the cursor
     bool scroll(context const&ctx, point dir, point p) override
     {
-        auto size = ctx.bounds.size();
-        auto pos = ctx.bounds.top_left();
-        const point relative((p.x - pos.x) / size.x, (p.y - pos.y) / size.y);
-        for(size_t i = 0; i < samples.size() - 1; i++)
-        {
-            if(relative.x > samples[i].x && relative.x < samples[i + 1].x) {
-                samples[i].curve += (dir.y / 10.0);
-                ctx.view.refresh();
-                return true;
-            }
+        const point relative = to_relative(ctx, p);
+        if(control_down) {
+            const float width = view_width * pow(1.1f, -dir.y);
+            const float w = std::clamp(width, min_view_width, 1.0f);
+            set_view(relative.x - (p.x - ctx.bounds.left) / ctx.bounds.width() * w, w);
+            invalidate(ctx, ctx.bounds);
+            return true;
+        }
+        if(dir.x != 0) {
+            set_view(view_first - dir.x / ctx.bounds.width() * view_width, view_width);
+            invalidate(ctx, ctx.bounds);
+            return true;
+        }
+        const int at = lane_at(ctx, p);
+        if(at == -1) return true;
+        if(size_t(at) != active_lane) select_lane(ctx, size_t(at));
+        curves::curve_lane &lane = active();
+        const int i = curves::knot_index::find_segment(lane.samples, relative.x);
+        if(i != -1) {
+            // successive scrolls on one segment make one step
+            if(i != scrolled_segment) close_edit();
+            begin_edit();
+            scrolled_segment = i;
+            lane.samples.set_curve(i, lane.samples[i].curve + (dir.y / 10.0));
+            lane.samples_version++;
+            // a wheel sends many ticks per frame, the curve is published once per frame
+            commit_pending = true;
+            const context lctx = lane_context(ctx, active_lane);
+            invalidate(ctx, x_area(lctx, lane.samples[i].x, lane.samples[i + 1].x));
         }
         return true;
     }
 
+    // Stale polylines of the visible lanes are rebuilt in parallel first, then
+    // every visible lane is drawn from its cache. Lanes out of view are not
+    // touched, and neither are the lanes and knots outside of the repainted area.
     void draw(const context &ctx) override
     {
         canvas& cnv = ctx.canvas;
+        const rect area = cnv.clip_extent();
         cnv.fill_color(color(0.1, 0.1, 0.1));
         cnv.add_rect(ctx.bounds);
         cnv.fill();
-        this->draw_grid(ctx);
-        this->draw_segments(ctx);
-        this->draw_samples(ctx);
+
+        const size_t end = lanes_end(ctx);
+        stale.clear();
+        for(size_t i = first_lane; i < end; i++)
+        {
+            curves::curve_lane &lane = *lanes[i];
+            const context lctx = lane_context(ctx, i);
+            if(lane.samples.empty() || !intersects(lctx.bounds, area)) continue;
+            stale_lane s{&lane, curve_scale(lctx), 0, 0};
+            visible_knots(lctx, lane, 0, s.first, s.last);
+            if(!lane.cache_valid(s.scale, s.first, s.last)) stale.push_back(s);
+        }
+        pool.run(stale.size(), [this](size_t i) {
+            const stale_lane &s = stale[i];
+            s.lane->build_polyline(s.scale, s.first, s.last, flatten_tolerance);
+        });
+
+        for(size_t i = first_lane; i < end; i++)
+        {
+            const context lctx = lane_context(ctx, i);
+            if(!intersects(lctx.bounds, area)) continue;
+            if(i == active_lane) {
+                cnv.fill_color(color(0.14, 0.14, 0.14));
+                cnv.add_rect(lctx.bounds);
+                cnv.fill();
+            }
+            this->draw_grid(lctx);
+            this->draw_segments(lctx, *lanes[i], area);
+            if(i == active_lane) {
+                this->draw_samples(lctx, *lanes[i], selected, focused, area);
+                this->draw_stroke(lctx);
+            } else {
+                this->draw_samples(lctx, *lanes[i], -1, -1, area);
+            }
+        }
     }
 
     void layout(const context &ctx) override
@@ -373,13 +743,20 @@ public:
 
     bool cursor(context const &ctx, point p, cursor_tracking status) override
     {
-        const int found = find_sample(p, ctx);
+        const context lctx = lane_context(ctx, active_lane);
+        int found = -1;
+        if(lane_at(ctx, p) == int(active_lane)) {
+            found = find_sample(p, lctx);
+            last_position = to_relative(lctx, p);
+        }
         if(found != focused) {
+            // only the focus rings change
+            const curves::curve_lane &lane = active();
+            if(focused >= 0 && focused < int(lane.samples.size()))
+                invalidate(ctx, marker_area(lctx, lane.samples[focused]));
+            if(found >= 0) invalidate(ctx, marker_area(lctx, lane.samples[found]));
             focused = found;
-            ctx.view.refresh();
         }
-        last_position = point( (p.x - ctx.bounds.top_left().x) / ctx.bounds.size().x,
-                               (p.y - ctx.bounds.top_left().y) / ctx.bounds.size().y);
         return true;
     }
 
@@ -387,6 +764,7 @@ public:
     {
         if(focused == -1) return;
         if(!grid_enabled) return;
+        curves::curve_lane &lane = active();
 
         float x_snap = -1.0f, y_snap = -1.0f;
 
@@ -395,47 +773,73 @@ public:
          for(size_t i = 0; i < grid_steps + 1; i++) {
              const float relative = (float(i) / float(grid_steps));
 
-             const float x_dist = std::abs(samples[focused].x - relative);
+             const float x_dist = std::abs(lane.samples[focused].x - relative);
              if(x_dist < (step_d2)) x_snap = relative;
 
-             const float y_dist = std::abs(samples[focused].y - relative);
+             const float y_dist = std::abs(lane.samples[focused].y - relative);
              if(y_dist < (step_d2)) y_snap = relative;
 
              if( (x_snap != -1.0f) && (y_snap != -1.0f) ) break;
          }
 
-         samples[focused].x = x_snap;
-         samples[focused].y = y_snap;
-         if( size_t(focused) < samples.size() - 1 && samples[focused].x > samples[focused + 1].x) {
-             std::swap(samples[focused], samples[focused + 1]);
-             focused += 1;
-         }
-         else if( focused > 0 && samples[focused].x < samples[focused - 1].x ) {
-             std::swap(samples[focused], samples[focused - 1]);
-             focused -= 1;
-         }
+         begin_edit();
+         focused = lane.samples.move(focused, x_snap, y_snap);
+         lane.moved_sample = -2;
+         lane.samples_version++;
          ctx.view.refresh();
     }
 
     bool click(const context &ctx, mouse_button btn) override
     {
 
+        if(btn.down && btn.modifiers == mod_control) { // pan
+            panning = true;
+            pan_origin = btn.pos.x;
+            pan_first = view_first;
+            return true;
+        }
+        if(!btn.down && panning) {
+            panning = false;
+            return true;
+        }
+        if(btn.down) { // a click in another lane selects it
+            const int at = lane_at(ctx, btn.pos);
+            if(at == -1) return true;
+            if(size_t(at) != active_lane) select_lane(ctx, size_t(at));
+        }
+        const context lctx = lane_context(ctx, active_lane);
+        if(!btn.down && stroking) {
+            end_stroke();
+            commit_edit();
+            ctx.view.refresh();
+            return true;
+        }
+        close_edit();
+        if(btn.down && freehand && btn.modifiers == 0) {
+            begin_stroke(lctx, btn.pos);
+            ctx.view.refresh();
+            return true;
+        }
         if(btn.down) {
-            const int found = find_sample(btn.pos, ctx);
+            const int found = find_sample(btn.pos, lctx);
             auto t2 = std::chrono::high_resolution_clock::now();
             const double dur =
                     std::chrono::duration_cast<std::chrono::milliseconds>(t2 - last_click).count();
             if(dur < 200) { // double click (200 ms)
-                snap_to_grid(ctx);
+                snap_to_grid(lctx);
             }
             else { // simple click
                 last_click = std::chrono::high_resolution_clock::now();
                 if(found == -1 && btn.modifiers == 0) { // no sample here
-                    add_sample(btn.pos, ctx);
+                    add_sample(btn.pos, lctx);
                     focused = selected; // add_sample selects the added sample
                 } else { // sample here
                     if( (btn.modifiers == mod_alt || btn.modifiers == mod_shift) && found != -1 ) {
-                        samples.erase(samples.begin() + found);
+                        curves::curve_lane &lane = active();
+                        begin_edit();
+                        lane.samples.erase(found);
+                        lane.moved_sample = -2;
+                        lane.samples_version++;
                         selected = -1;
                         focused = -1;
                     } else {
@@ -446,10 +850,31 @@ public:
         } else { // btn up
             selected = -1;
         }
+        commit_edit();
         ctx.view.refresh();
         return true;
     }
 
+    // Ships the curve of a lane to real-time consumers once an edit is complete,
+    // drags are published on release and wheel scrolls once per frame
+    void publish(curves::curve_lane &lane)
+    {
+        if(lane.published_version == lane.samples_version && lane.published_mode == lane.mode) return;
+        lane.publisher.publish(lane.samples, lane.mode, published_table_size, lane.samples_version);
+        lane.published_version = lane.samples_version;
+        lane.published_mode = lane.mode;
+    }
+
+    void commit_edit()
+    {
+        publish(active());
+    }
+
+    curves::curve_publisher<float> &get_publisher(size_t lane = 0)
+    {
+        return lanes[lane]->publisher;
+    }
+
     void end_tracking(const context &, tracker_info &) override
     {
     }
@@ -471,68 +896,116 @@ public:
 
     void drag(const context &ctx, mouse_button btn) override
     {
-        auto size = ctx.bounds.size();
-        auto pos = ctx.bounds.top_left();
-        const point btn_pos = in_bounds(ctx, btn.pos);
-        const point btn_pos_relative( (btn_pos.x - pos.x) / size.x, (btn_pos.y - pos.y) / size.y );
-        if(selected != -1)  { // drag sample and swap if necessary
-            samples[selected].x = btn_pos_relative.x;
-            samples[selected].y = btn_pos_relative.y;
-            if( size_t(selected) < samples.size() - 1 && samples[selected].x > samples[selected + 1].x) {
-                std::swap(samples[selected], samples[selected + 1]);
-                selected +=1;
-                focused += 1;
+        if(panning) {
+            set_view(pan_first - (btn.pos.x - pan_origin) / ctx.bounds.width() * view_width, view_width);
+            invalidate(ctx, ctx.bounds);
+            return;
+        }
+        // the pen stays in the lane the drag started in
+        const context lctx = lane_context(ctx, active_lane);
+        curves::curve_lane &lane = active();
+        const point btn_pos = in_bounds(lctx, btn.pos);
+        if(stroking) {
+            // the pending line and the knots swept since the last knot
+            const float x0 = stroke.anchor().x, x1 = stroke.end().x;
+            extend_stroke(lctx, btn_pos);
+            const float x2 = stroke.end().x;
+            const float lo = std::min({x0, x1, x2}), hi = std::max({x0, x1, x2});
+            invalidate(ctx, x_area(lctx, lo, hi));
+            // plus the segments joining the stroke to the knots around it
+            if(!lane.samples.empty()) {
+                const size_t last = lane.samples.size() - 1;
+                invalidate(ctx, knot_area(lctx, lane, std::min(last, curves::knot_index::lower_bound_x(lane.samples, lo))));
+                invalidate(ctx, knot_area(lctx, lane, std::min(last, curves::knot_index::upper_bound_x(lane.samples, hi))));
             }
-            else if( selected > 0 && samples[selected].x < samples[selected - 1].x ) {
-                std::swap(samples[selected], samples[selected - 1]);
-                selected -=1;
-                focused -= 1;
+            return;
+        }
+        const point btn_pos_relative = to_relative(lctx, btn_pos);
+        if(selected != -1)  { // drag sample, reordering if necessary
+            // a lone moved sample lets the spline update incrementally
+            begin_edit();
+            lane.moved_sample = (lane.moved_sample == -1 || lane.moved_sample == selected) ? selected : -2;
+            const size_t before = lane.samples_version++;
+            invalidate(ctx, knot_area(lctx, lane, size_t(selected)));
+            const int moved = int(lane.samples.move(selected, btn_pos_relative.x, btn_pos_relative.y));
+            lane.knots_index.knot_moved(lane.samples, size_t(selected), size_t(moved), before, lane.samples_version);
+            if(moved != selected) { // passed over other samples
+                selected = moved;
+                focused = moved;
+                lane.moved_sample = -2;
             }
-            ctx.view.refresh();
+            invalidate(ctx, knot_area(lctx, lane, size_t(selected)));
         } else if(selected == -1 && (btn.modifiers == mod_alt || btn.modifiers == mod_shift)){ // find segment
-            if( (btn_pos_relative.x < samples.front().x) || (btn_pos_relative.x > samples.back().x) ) return;
-            for(size_t i = 0; i < samples.size() - 1; i++)
-            {
-                   if( (btn_pos_relative.x > samples[i].x) && (btn_pos_relative.x < samples[i + 1].x))
-                   {
-                      samples[i].curve += (last_position.y - btn_pos_relative.y);
-                      if(samples[i].curve > 10.0) samples[i].curve = 10.0f;
-                      else if(samples[i].curve < -10.0) samples[i].curve = -10.0f;
-                      break;
-                   }
-            }
-
-            if(mode == log_exp) {
-                ctx.view.refresh();
+            const int i = curves::knot_index::find_segment(lane.samples, btn_pos_relative.x);
+            if(i == -1) return;
+            begin_edit();
+            const float curve = lane.samples[i].curve + (last_position.y - btn_pos_relative.y);
+            lane.samples.set_curve(i, std::clamp(curve, -10.0f, 10.0f));
+            lane.samples_version++;
+
+            if(lane.mode == log_exp) {
+                invalidate(ctx, x_area(lctx, lane.samples[i].x, lane.samples[i + 1].x));
             }
         }
     }
 
     curve_editor_controller value() const override
     {
-        return curve_editor_controller(mode, granularity, grid_steps);
+        return curve_editor_controller(lanes[active_lane]->mode, granularity, grid_steps);
     }
 
+    // The mode applies to the active lane
     void value(curve_editor_controller val) override
     {
-        mode = val.mode;
+        active().mode = val.mode;
         grid_steps = val.grid_steps;
         granularity = val.granularity;
+        commit_edit();
     }
 
 
 private:
+    // a lane whose polyline is rebuilt before drawing, see draw()
+    struct stale_lane
+    {
+        curves::curve_lane *lane;
+        point scale;
+        size_t first, last;
+    };
+
     color background_color, grid_color, curve_color, button_color;
     point last_position;
-    curves::cubic_spline<float> spline;
     bool grid_enabled = true;
     size_t grid_steps;
     size_t granularity;
     std::chrono::high_resolution_clock::time_point last_click;
-    curve_mode mode;
+    // lanes are never removed, so their publishers stay valid
+    vector<std::unique_ptr<curves::curve_lane>> lanes;
+    size_t active_lane = 0;
+    // first lane in view when they do not all fit
+    size_t first_lane = 0;
+    vector<stale_lane> stale;
+    curves::task_pool pool;
     int selected = -1;
     int focused = -1;
-    std::vector<curve_point> samples;
+    // visible x range, in relative coordinates
+    constexpr static const float min_view_width = 1e-4f;
+    float view_first = 0.0f, view_width = 1.0f;
+    bool control_down = false;
+    bool panning = false;
+    bool freehand = false;
+    bool stroking = false;
+    curves::stroke_simplifier stroke;
+    float pan_origin = 0.0f, pan_first = 0.0f;
+    constexpr static const size_t published_table_size = 4096;
+    // x pixel of the last knot drawn on each row, see draw_samples()
+    vector<int> marked_rows;
+    bool edit_open = false;
+    int scrolled_segment = -1;
+    // area to repaint at the next frame, see invalidate()
+    rect dirty_area;
+    bool frame_pending = false;
+    bool commit_pending = false;
 
 };
 
@@ -560,6 +1033,9 @@ auto my_app::make_mode_buttons()
    auto quadbezier = custom_radio_button("quad bezier");
    auto cubbezier = custom_radio_button("cubbezier");
    auto linear = custom_radio_button("linear");
+   auto monotone = custom_radio_button("monotone");
+   auto akima = custom_radio_button("akima");
+   auto catmull_rom = custom_radio_button("catmull-rom");
 
    linear.select(true);
    spline_mode.on_click = [&](bool b) {
@@ -588,10 +1064,26 @@ auto my_app::make_mode_buttons()
        editor.value(curve_editor_controller(curve_mode::linear));
        _view.refresh();
    };
+   monotone.on_click = [&](bool b) {
+       if(!b) return;
+       editor.value(curve_editor_controller(curve_mode::monotone_cubic));
+       _view.refresh();
+   };
+   akima.on_click = [&](bool b) {
+       if(!b) return;
+       editor.value(curve_editor_controller(curve_mode::akima));
+       _view.refresh();
+   };
+   catmull_rom.on_click = [&](bool b) {
+       if(!b) return;
+       editor.value(curve_editor_controller(curve_mode::catmull_rom));
+       _view.refresh();
+   };
 
 
    return group("curve mode", top_margin(25, margin({10,10,10,10}, htile(
-               linear, hspacer(3), log_exp, hspacer(3), spline_mode, hspacer(3),  cubbezier,  hspacer(3), quadbezier
+               linear, hspacer(3), log_exp, hspacer(3), spline_mode, hspacer(3),  cubbezier,  hspacer(3), quadbezier,
+               hspacer(3), monotone, hspacer(3), akima, hspacer(3), catmull_rom
                ))));
 }
 
@@ -612,8 +1104,15 @@ void my_app::make_info_popup()
     std::string help = "Curve Editor \n"
                        "Click on the canvas and plot samples to draw 2D curves. \n"
                        "There are several modes (displayed at the bottom). Some require 2 samples to work (linear, log_exp), while some require 3 (cubic spline, quadbezier) or 4 (cubbezier). \n"
+                       "Monotone, akima and catmull-rom pass through every sample like the spline, but a sample only bends its neighbouring segments; monotone never overshoots. \n"
                        "To curve the log_exp mode you can alt or shift click + drag up / down or simply scroll. \n"
-                       "Alt+click or shift+click on a sample removes it.\n";
+                       "Alt+click or shift+click on a sample removes it.\n"
+                       "Control + scroll zooms in and out, control+click + drag or horizontal scroll pans.\n"
+                       "Control+z undoes the last edit, control+y or control+shift+z redoes it.\n"
+                       "Control+n adds a curve lane below the others, control+up / down or a click selects a lane.\n"
+                       "The mode buttons apply to the selected lane.\n"
+                       "Control+s saves every lane to curves.crvl, control+o opens them back.\n"
+                       "Control+f toggles freehand drawing : click + drag draws over the samples it crosses.\n";
     auto on_ok = [&](){
 
     };
@@ -6,8 +6,12 @@
 #include<unordered_map>
 #include<math.h>
 #include<functional>
+#include<algorithm>
+#include<cstdint>
+#include<memory.h>
 #include<elements.hpp>
 #include"curve_point.h"
+#include"task_pool.h"
 
 using namespace std;
 using namespace cycfi::elements;
@@ -28,31 +32,23 @@ public:
     {
     }
 
-    void gauss_elimination_ls(int m, int n)
+    // Thomas algorithm on the (n - 1) x (n - 1) tridiagonal system of the natural spline.
+    // Row i - 1 solves sig[i] : its diagonal is diag[i - 1], and its sub and super
+    // diagonals are h[i - 1] and h[i], so only diag, rhs and one scratch vector are stored.
+    void thomas_solve(int n)
     {
-        int i, j, k;
-        for( i = 0; i < m - 1; i++)
+        const int m = n - 1;
+        scratch[0] = h[1] / diag[0];
+        sig[1] = rhs[0] / diag[0];
+        for(int r = 1; r < m; r++)
         {
-            for(k = i + 1; k < m; k++)
-            {
-                double term = tridiagonal[k][i] / tridiagonal[i][i];
-                for(j = 0; j < n; j++)
-                {
-                    tridiagonal[k][j] = tridiagonal[k][j] -
-                            term * tridiagonal[i][j];
-                }
-            }
+            const T denom = diag[r] - h[r] * scratch[r - 1];
+            scratch[r] = h[r + 1] / denom;
+            sig[r + 1] = (rhs[r] - h[r] * sig[r]) / denom;
         }
-
-        // Back substitution
-        for(i = m - 1; i >= 0; i--)
+        for(int r = m - 2; r >= 0; r--)
         {
-            sig_temp[i] = tridiagonal[i][n - 1];
-            for(j = i + 1; j < n - 1; j++)
-            {
-                sig_temp[i] = sig_temp[i] - tridiagonal[i][j] * sig_temp[j];
-            }
-            sig_temp[i] = sig_temp[i] / tridiagonal[i][i];
+            sig[r + 1] = sig[r + 1] - scratch[r] * sig[r + 2];
         }
     }
 
@@ -70,44 +66,94 @@ public:
 
     void tridiagonal_cubic_splin_gen(int n)
     {
-        int i;
-        for(i = 0; i < n - 1; i++)
+        for(int i = 1; i < n; i++)
         {
-            tridiagonal[i][i] = 2 * (h[i]+ h[i + 1]);
+            diag[i - 1] = 2 * (h[i - 1] + h[i]);
+            rhs[i - 1] = (y[i + 1] - y[i]) * 6.0 / h[i] -
+                    (y[i] - y[i - 1]) * 6.0 / h[i - 1];
         }
-        for(i = 0; i < n - 2; i++)
-        {
-            tridiagonal[i][i + 1] = h[i + 1];
-            tridiagonal[i + 1][i] = h[i + 1];
+    }
+
+    T equation(T xval, T x_i, int i)
+    {
+        const T t = xval - x_i;
+        return ((a[i] * t + b[i]) * t + c[i]) * t + d[i];
+    }
+
+    // Output indices [first, last) whose abscissa T(i) / n_precision falls in segment i,
+    // the last segment including its end point
+    void segment_range(int n, int i, int &first, int &last)
+    {
+        const T prec = T(n_precision);
+        first = std::max(0, int(ceil(x[i] * prec)));
+        while(first > 0 && T(first - 1) / prec >= x[i]) first--;
+        while(first < n_precision && T(first) / prec < x[i]) first++;
+
+        last = std::min(n_precision, int(ceil(x[i + 1] * prec)));
+        while(last > 0 && T(last - 1) / prec >= x[i + 1]) last--;
+        while(last < n_precision && T(last) / prec < x[i + 1]) last++;
+        if(i == n - 1) {
+            while(last < n_precision && T(last) / prec <= x[n]) last++;
         }
-        for(i = 1; i < n; i++)
+        if(last < first) last = first;
+    }
+
+    // Horner evaluation of segment i over output indices [first, last).
+    // Branch free with loop invariant coefficients, so it vectorizes.
+    void evaluate_segment(int i, int first, int last)
+    {
+        const T ca = a[i], cb = b[i], cc = c[i], cd = d[i], x_i = x[i];
+        const T prec = T(n_precision);
+        T *out = interp.data();
+        for(int idx = first; idx < last; idx++)
         {
-            tridiagonal[i - 1][n - 1] = (y[i + 1] - y[i]) * 6.0 / h[i] -
-                    (y[i] - y[i - 1]) * 6.0 / h[i - 1];
+            const T t = T(idx) / prec - x_i;
+            out[idx] = ((ca * t + cb) * t + cc) * t + cd;
         }
     }
 
-    T equation(T xval, T x_i, int i)
+    // Evaluates segments [seg_begin, seg_end) into interp
+    void evaluate_segments(int n, int seg_begin, int seg_end)
     {
-        return (a[i] * pow((xval - x_i), 3)) + (b[i] * pow((xval - x_i), 2)) +
-                (c[i] * (xval - x_i)) + d[i];
+        for(int i = seg_begin; i < seg_end; i++)
+        {
+            int first, last;
+            segment_range(n, i, first, last);
+            evaluate_segment(i, first, last);
+        }
     }
 
-    void calculate_interpolation(int n)
+    // Evaluates the output indices [out_first, out_last) only
+    void evaluate_output_range(int n, int out_first, int out_last)
     {
-        int key_index = 0;
-        T key = x[key_index];
-        for (int i = 0; i < interp.size(); i++)
+        // first segment whose range may reach out_first
+        int i = int(std::upper_bound(x.begin(), x.begin() + n, T(out_first) / T(n_precision)) - x.begin()) - 1;
+        for(i = std::max(0, i); i < n; i++)
         {
-            T xval = T(i) / T(n_precision);
-            if((xval < x[0]) || (xval > x.back()) ) continue;
-            if(xval > x[key_index + 1]) {
-                key_index++;
-                key = x[key_index];
-            }
-            interp[i] = equation(xval, key, key_index);  //equation_map[key](xval);
+            int first, last;
+            segment_range(n, i, first, last);
+            if(first >= out_last) break;
+            evaluate_segment(i, std::max(first, out_first), std::min(last, out_last));
+        }
+    }
+
+    // Large outputs are split in contiguous index ranges, one per thread of the pool.
+    // Without a pool the caller evaluates everything : pass none from a task of the pool.
+    void calculate_interpolation(int n, task_pool *pool)
+    {
+        const int n_tasks = (pool == nullptr) ? 1 :
+                std::min(int(pool->threads()), n_precision / parallel_grain);
+        if(n_tasks <= 1) {
+            evaluate_segments(n, 0, n);
+        } else {
+            pool->run(size_t(n_tasks), [this, n, n_tasks](size_t t) {
+                const int out_first = int(int64_t(n_precision) * int64_t(t) / n_tasks);
+                const int out_last = int(int64_t(n_precision) * int64_t(t + 1) / n_tasks);
+                evaluate_output_range(n, out_first, out_last);
+            });
         }
-       // equation_map.clear();
+        dirty_first = 0;
+        dirty_last = n_precision;
     }
 
     void resize(int n)
@@ -123,67 +169,219 @@ public:
         d.resize(n);
 
         sig.resize(n + 1);
-        sig_temp.resize(n - 1);
+        diag.resize(std::max(0, n - 1));
+        rhs.resize(std::max(0, n - 1));
+        scratch.resize(std::max(0, n - 1));
+    }
 
-        tridiagonal.resize(n - 1);
-        for(int i = 0; i < tridiagonal.size(); i++)
+    template<typename Points>
+    void reset(int n, const Points &p)
+    {
+        int i = 0;
+        for(auto & it : p)
         {
-            tridiagonal[i].resize(n);
+            x[i] = it.x;
+            y[i] = it.y;
+            i++;
         }
 
+        // fill rather than memset : the vectors are empty for a single knot
+        std::fill(h.begin(), h.begin() + n, T(0));
+
+        std::fill(a.begin(), a.begin() + n, T(0));
+        std::fill(b.begin(), b.begin() + n, T(0));
+        std::fill(c.begin(), c.begin() + n, T(0));
+        std::fill(d.begin(), d.begin() + n, T(0));
+
+        std::fill(sig.begin(), sig.begin() + n + 1, T(0));
+
+        std::fill(interp.begin(), interp.begin() + n_precision, T(0));
     }
 
-    void reset(int n, vector<curve_point> &p)
+    // With fewer than 3 knots there is no system : one knot is held, two are joined by a line
+    void solve(int n)
     {
-        for(int i = 0; i < p.size(); i++)
-        {
-            x[i] = p[i].x;
-            y[i] = p[i].y;
+        int i;
+        for(i = 0; i < n; i++)
+            h[i] = x[i + 1] - x[i];
+        if(n < 2) {
+            for(i = 0; i < n; i++)
+            {
+                a[i] = b[i] = 0;
+                c[i] = (h[i] > 0) ? (y[i + 1] - y[i]) / h[i] : T(0);
+                d[i] = y[i];
+            }
+            return;
         }
 
-        ::memset(h.data(), 0, n * sizeof(T));
+        sig[0] = 0;
+        sig[n] = 0;
+
+        tridiagonal_cubic_splin_gen(n);
+        thomas_solve(n);
 
-        ::memset(a.data(), 0, n * sizeof(T));
-        ::memset(b.data(), 0, n * sizeof(T));
-        ::memset(c.data(), 0, n * sizeof(T));
-        ::memset(d.data(), 0, n * sizeof(T));
+        cs_coeff_calculation(n);
+    }
 
-        ::memset(sig.data(), 0, (n + 1) * sizeof(T)  );
-        ::memset(sig_temp.data(), 0, (n - 1) * sizeof(T) );
+    void interpolate(int n, task_pool *pool)
+    {
+        solve(n);
+        calculate_interpolation(n, pool);
+    }
 
-        for(int i = 0; i < tridiagonal.size(); i++)
+    // Solves the system restricted to sig[lo .. hi], with sig[lo - 1] and sig[hi + 1]
+    // held at their current values, into local_sig
+    void local_solve(int lo, int hi)
+    {
+        const int m = hi - lo + 1;
+        local_sig.resize(m);
+        local_scratch.resize(m);
+        for(int r = 0; r < m; r++)
         {
-            ::memset(tridiagonal[i].data(), 0, n * sizeof(T) );
+            const int i = lo + r;
+            T r_hs = rhs[i - 1];
+            if(r == 0) r_hs -= h[i - 1] * sig[i - 1];
+            if(r == m - 1) r_hs -= h[i] * sig[i + 1];
+            const T lower = (r == 0) ? T(0) : h[i - 1];
+            const T denom = diag[i - 1] - ((r == 0) ? T(0) : lower * local_scratch[r - 1]);
+            local_scratch[r] = (r == m - 1) ? T(0) : h[i] / denom;
+            local_sig[r] = (r_hs - ((r == 0) ? T(0) : lower * local_sig[r - 1])) / denom;
         }
+        for(int r = m - 2; r >= 0; r--)
+            local_sig[r] = local_sig[r] - local_scratch[r] * local_sig[r + 1];
+    }
 
-
-
-        ::memset(interp.data(), 0, sizeof(T) * n_precision);
+    // Incremental update after knot k moved without changing the knot order.
+    // The influence of one knot on the natural spline decays geometrically, so the
+    // system is re-solved on a window around k that grows until the change at its
+    // edges falls below tolerance. Only the coefficients are updated, for
+    // segment_value() and sample().
+    // Falls back to build() when the knot count changed.
+    template<typename Points>
+    void update_coefficients(const Points &p, int k, T tolerance = T(1e-6))
+    {
+        const int n = int(p.size()) - 1;
+        if(n_points != int(p.size()) || n < 2 || k < 0 || k > n) {
+            build(p);
+            return;
+        }
+        int seg_begin, seg_end;
+        update_knot(p, k, tolerance, seg_begin, seg_end);
     }
 
-    void interpolate(int n)
+    // Same, also re-evaluating the output of the segments whose coefficients moved
+    // by more than tolerance, see dirty_begin() / dirty_end().
+    // Falls back to a full rebuild when the knot count or precision changed.
+    template<typename Points>
+    vector<T>& update_point(Points &p, int k, int precision,
+                            point &size, T tolerance = T(1e-6))
     {
+        const int n = int(p.size()) - 1;
+        if(n_points != int(p.size()) || precision != n_precision || n < 2 ||
+                k < 0 || k > n)
+            return interpolate_from_points(p, precision, size);
+
+        int dirty_seg_begin, dirty_seg_end;
+        update_knot(p, k, tolerance, dirty_seg_begin, dirty_seg_end);
+
+        // the moved knot may have uncovered output points on either side of the curve
+        int first, last;
+        segment_range(n, dirty_seg_begin, first, last);
+        dirty_first = first;
+        segment_range(n, dirty_seg_end - 1, first, last);
+        dirty_last = last;
+        if(k == 0) {
+            segment_range(n, 0, first, last);
+            std::fill(interp.begin(), interp.begin() + first, T(0));
+            dirty_first = 0;
+        }
+        if(k == n) {
+            std::fill(interp.begin() + dirty_last, interp.end(), T(0));
+            dirty_last = n_precision;
+        }
+        evaluate_segments(n, dirty_seg_begin, dirty_seg_end);
+        return interp;
+    }
 
-        int i;
-        for(i = 0; i < n; i++)
-            h[i] = x[i + 1] - x[i];
+    // Segments of the last built spline, segment i going from knot_x(i) to knot_x(i + 1)
+    int segments() const {return n_points - 1;}
+    T knot_x(int i) const {return x[i];}
 
-        sig[0] = 0;
-        sig[n] = 0;
+    T segment_value(int i, T xval) const
+    {
+        const T t = xval - x[i];
+        return ((a[i] * t + b[i]) * t + c[i]) * t + d[i];
+    }
 
-        tridiagonal_cubic_splin_gen(n);
-        gauss_elimination_ls(n -1, n);
+    // Segment i is ((ca * t + cb) * t + cc) * t + cd, with t = x - knot_x(i)
+    void coefficients(int i, T &ca, T &cb, T &cc, T &cd) const
+    {
+        ca = a[i];
+        cb = b[i];
+        cc = c[i];
+        cd = d[i];
+    }
 
-        for(i = 1; i < n; i++)
-            sig[i] = sig_temp[i - 1];
+    // Output range rewritten by the last rebuild or update
+    int dirty_begin() const {return dirty_first;}
+    int dirty_end() const {return dirty_last;}
 
-        cs_coeff_calculation(n);
-        calculate_interpolation(n);
+    // Computes the coefficients only, for sample()
+    template<typename Points>
+    void build(const Points &p)
+    {
+        if(p.empty()) {
+            n_points = 0;
+            return;
+        }
+        const int n = int(p.size()) - 1;
+        if(n_points != int(p.size()))
+        {
+            this->resize(n);
+            n_points = p.size();
+        }
+        reset(n, p);
+        solve(n);
     }
 
-    vector<T>& interpolate_from_points(vector<curve_point> &p,
-                                            int precision, point &size)
+    // Evaluates the last built spline at x = j * step for j in [0, size),
+    // holding the end knot values outside of the knot range
+    void sample(T *out, int size, T step) const
     {
+        if(n_points == 0) {
+            std::fill(out, out + size, T(0));
+            return;
+        }
+        const int n = n_points - 1;
+        int j = 0;
+        for(; j < size && T(j) * step < x[0]; j++)
+            out[j] = y[0];
+        for(int i = 0; i < n && j < size; i++)
+        {
+            int last = j;
+            while(last < size && (T(last) * step < x[i + 1] || (i == n - 1 && T(last) * step <= x[n])))
+                last++;
+            const T ca = a[i], cb = b[i], cc = c[i], cd = d[i], x_i = x[i];
+            for(; j < last; j++)
+            {
+                const T t = T(j) * step - x_i;
+                out[j] = ((ca * t + cb) * t + cc) * t + cd;
+            }
+        }
+        for(; j < size; j++)
+            out[j] = y[n];
+    }
+
+    template<typename Points>
+    vector<T>& interpolate_from_points(Points &p,
+                                            int precision, point &size, task_pool *pool = nullptr)
+    {
+        if(p.empty()) {
+            n_points = 0;
+            interp.assign(precision, T(0));
+            n_precision = precision;
+            return interp;
+        }
         int n = p.size() - 1;
         if(n_points != p.size())
         {
@@ -198,15 +396,72 @@ public:
 
         reset(n, p);
 
-        this->interpolate(n);
+        this->interpolate(n, pool);
 
         return interp;
     }
 
 private:
+
+    // Moves knot k and re-solves around it, [dirty_seg_begin, dirty_seg_end) being
+    // the segments whose coefficients changed by more than tolerance
+    template<typename Points>
+    void update_knot(const Points &p, int k, T tolerance, int &dirty_seg_begin, int &dirty_seg_end)
+    {
+        const int n = n_points - 1;
+        x[k] = p[k].x;
+        y[k] = p[k].y;
+        for(int i = std::max(0, k - 1); i <= std::min(n - 1, k); i++)
+            h[i] = x[i + 1] - x[i];
+        for(int i = std::max(1, k - 1); i <= std::min(n - 1, k + 1); i++)
+        {
+            diag[i - 1] = 2 * (h[i - 1] + h[i]);
+            rhs[i - 1] = (y[i + 1] - y[i]) * 6.0 / h[i] -
+                    (y[i] - y[i - 1]) * 6.0 / h[i - 1];
+        }
+
+        int width = 4, lo, hi;
+        for(;;)
+        {
+            lo = std::max(1, k - width);
+            hi = std::min(n - 1, k + width);
+            local_solve(lo, hi);
+            const bool lo_done = (lo == 1) || std::abs(local_sig[0] - sig[lo]) <= tolerance;
+            const bool hi_done = (hi == n - 1) || std::abs(local_sig[hi - lo] - sig[hi]) <= tolerance;
+            if(lo_done && hi_done) break;
+            width *= 2;
+        }
+        for(int i = lo; i <= hi; i++)
+            sig[i] = local_sig[i - lo];
+
+        // segments touching a changed sig or the moved knot
+        const int seg_begin = std::max(0, std::min(lo, k) - 1);
+        const int seg_end = std::min(n, std::max(hi, k) + 1);
+        dirty_seg_begin = seg_end;
+        dirty_seg_end = seg_begin;
+        for(int i = seg_begin; i < seg_end; i++)
+        {
+            const T na = (sig[i + 1] - sig[i]) / (h[i] * 6.0);
+            const T nb = sig[i] / 2.0;
+            const T nc = (y[i + 1] - y[i]) / h[i] - h[i] * (2.0 * sig[i] + sig[i + 1]) / 6.0;
+            const T nd = y[i];
+            const bool changed = std::abs(na - a[i]) > tolerance || std::abs(nb - b[i]) > tolerance ||
+                    std::abs(nc - c[i]) > tolerance || std::abs(nd - d[i]) > tolerance ||
+                    i == k - 1 || i == k;
+            a[i] = na; b[i] = nb; c[i] = nc; d[i] = nd;
+            if(changed) {
+                dirty_seg_begin = std::min(dirty_seg_begin, i);
+                dirty_seg_end = std::max(dirty_seg_end, i + 1);
+            }
+        }
+    }
+
+    constexpr static const int parallel_grain = 1 << 15;
+
     int n_points = 0, n_precision = 0;
-    vector<T> x, y, interp, a, b, c, d, sig, sig_temp, h;
-    vector< vector<T> > tridiagonal;
+    int dirty_first = 0, dirty_last = 0;
+    vector<T> x, y, interp, a, b, c, d, sig, h;
+    vector<T> diag, rhs, scratch, local_sig, local_scratch;
 };
 
 
@@ -0,0 +1,99 @@
+#ifndef STROKE_SIMPLIFIER_H
+#define STROKE_SIMPLIFIER_H
+
+#include<math.h>
+#include<algorithm>
+#include<elements.hpp>
+
+using namespace cycfi::elements;
+
+namespace curves {
+
+// Online simplification of a freehand stroke into knots.
+// The stroke is a function of x, so the error is measured vertically : from
+// the last knot (the anchor), every pending point q allows the slopes whose
+// line passes within `tolerance` of q. The intersection of these intervals is
+// kept as [lo, hi], and a new point whose slope leaves it makes the previous
+// point a knot. Each point costs O(1) and at most one knot is fixed per point.
+// The stroke direction is set by the first point with another x, points that
+// do not progress along it are dropped.
+class stroke_simplifier
+{
+public:
+
+    // Starts a stroke, p being its first knot
+    void begin(point p, float tolerance)
+    {
+        tolerance_ = tolerance;
+        anchor_ = last = p;
+        direction_ = 0;
+        pending = false;
+        raw = 1;
+    }
+
+    // Feeds a raw point, returns true when the previous point became a knot
+    bool add(point p, point &knot)
+    {
+        if(direction_ == 0) {
+            if(p.x == anchor_.x) return false;
+            direction_ = (p.x > anchor_.x) ? 1 : -1;
+        }
+        if((p.x - last.x) * direction_ <= 0.0f) return false;
+        raw++;
+        if(pending) {
+            const float s = slope(p, p.y);
+            if(s >= lo && s <= hi) {
+                narrow(p);
+                last = p;
+                return false;
+            }
+            knot = anchor_ = last;
+        }
+        lo = slope(p, p.y - tolerance_);
+        hi = slope(p, p.y + tolerance_);
+        last = p;
+        const bool fixed = pending;
+        pending = true;
+        return fixed;
+    }
+
+    // Ends the stroke, returns true with its last knot if not already fixed
+    bool finish(point &knot)
+    {
+        if(!pending) return false;
+        knot = anchor_ = last;
+        pending = false;
+        return true;
+    }
+
+    point anchor() const {return anchor_;}
+    // Last accepted raw point
+    point end() const {return last;}
+    // 1 or -1 once known, 0 before
+    int direction() const {return direction_;}
+    size_t raw_points() const {return raw;}
+
+private:
+
+    float slope(const point &p, float y) const
+    {
+        return (y - anchor_.y) / ((p.x - anchor_.x) * direction_);
+    }
+
+    void narrow(const point &p)
+    {
+        lo = std::max(lo, slope(p, p.y - tolerance_));
+        hi = std::min(hi, slope(p, p.y + tolerance_));
+    }
+
+    float tolerance_ = 0.0f;
+    point anchor_, last;
+    int direction_ = 0;
+    bool pending = false;
+    float lo = 0.0f, hi = 0.0f;
+    size_t raw = 0;
+};
+
+}
+
+#endif // STROKE_SIMPLIFIER_H
@@ -0,0 +1,101 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include<vector>
+#include<thread>
+#include<mutex>
+#include<condition_variable>
+#include<atomic>
+#include<functional>
+
+using namespace std;
+
+namespace curves {
+
+// Fixed set of worker threads running indexed tasks.
+// run() hands out the task indices through an atomic counter, takes its share
+// on the calling thread and returns once every task is done.
+// run() must not be called from one of its own tasks.
+class task_pool
+{
+public:
+
+    task_pool(size_t n_threads = std::thread::hardware_concurrency())
+    {
+        for(size_t i = 1; i < n_threads; i++)
+            workers.emplace_back([this](){ worker_loop(); });
+    }
+
+    ~task_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping = true;
+        }
+        start_cv.notify_all();
+        for(auto & it : workers) it.join();
+    }
+
+    size_t threads() const {return workers.size() + 1;}
+
+    void run(size_t n_tasks, const std::function<void(size_t)> &task)
+    {
+        if(workers.empty() || n_tasks <= 1) {
+            for(size_t i = 0; i < n_tasks; i++) task(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            current = &task;
+            total = n_tasks;
+            next = 0;
+            busy = workers.size();
+            generation++;
+        }
+        start_cv.notify_all();
+        work();
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_cv.wait(lock, [this](){ return busy == 0; });
+        current = nullptr;
+    }
+
+private:
+
+    void work()
+    {
+        for(;;)
+        {
+            const size_t i = next.fetch_add(1);
+            if(i >= total) return;
+            (*current)(i);
+        }
+    }
+
+    void worker_loop()
+    {
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        for(;;)
+        {
+            start_cv.wait(lock, [&](){ return stopping || generation != seen; });
+            if(stopping) return;
+            seen = generation;
+            lock.unlock();
+            work();
+            lock.lock();
+            if(--busy == 0) done_cv.notify_one();
+        }
+    }
+
+    vector<std::thread> workers;
+    std::mutex mutex_;
+    std::condition_variable start_cv, done_cv;
+    const std::function<void(size_t)> *current = nullptr;
+    std::atomic<size_t> next {0};
+    size_t total = 0, busy = 0, generation = 0;
+    bool stopping = false;
+};
+
+}
+
+#endif // TASK_POOL_H
@@ -0,0 +1,277 @@
+/*=============================================================================
+   Copyright (c) 2021 Johann Philippe
+
+   Distributed under the MIT License (https://opensource.org/licenses/MIT)
+=============================================================================*/
+#ifndef AVERAGING_H
+#define AVERAGING_H
+
+#include<vector>
+#include<algorithm>
+#include<atomic>
+
+using namespace std;
+
+enum class acquisition_mode {
+    normal = 0,
+    average = 1,
+    exp_average = 2,
+    envelope = 3
+};
+
+// Accumulates whole acquisition frames and produces one finished frame per push.
+// All accumulators are allocated up front, and every mode costs a fixed number of
+// operations per sample : the running average keeps a sum that is updated with the
+// incoming and the outgoing frame, so the cost does not depend on the depth.
+// The envelope decays toward the incoming frames with a time constant of depth
+// frames : a peak fades out after a few depths instead of staying forever.
+template<typename T>
+class frame_averager
+{
+public:
+
+    frame_averager(size_t frame_size, size_t max_depth = 64) :
+        frame_size_(frame_size), max_depth_(max_depth),
+        history(frame_size * max_depth, 0), sum(frame_size, 0),
+        out(frame_size, 0), env_min(frame_size, 0), env_max(frame_size, 0)
+    {}
+
+    void set_mode(acquisition_mode m)
+    {
+        mode = m;
+        reset();
+    }
+
+    acquisition_mode get_mode() const {return mode;}
+
+    void set_depth(size_t d)
+    {
+        depth = std::max(size_t(1), std::min(d, max_depth_));
+        reset();
+    }
+
+    void reset()
+    {
+        count = 0;
+        oldest = 0;
+        std::fill(sum.begin(), sum.end(), 0);
+    }
+
+    void push(const T *frame)
+    {
+        switch(mode)
+        {
+        case acquisition_mode::normal:
+            std::copy(frame, frame + frame_size_, out.begin());
+            break;
+        case acquisition_mode::average:
+            push_average(frame);
+            break;
+        case acquisition_mode::exp_average:
+            push_exp_average(frame);
+            break;
+        case acquisition_mode::envelope:
+            push_envelope(frame);
+            break;
+        }
+        if(count < depth) count++;
+    }
+
+    // finished frame (average modes), or the center of the envelope
+    const vector<T> &output() const {return out;}
+    const vector<T> &min_envelope() const {return env_min;}
+    const vector<T> &max_envelope() const {return env_max;}
+
+    size_t size() const {return frame_size_;}
+
+private:
+
+    void push_average(const T *frame)
+    {
+        T *slot = history.data() + oldest * frame_size_;
+        T *acc = sum.data();
+        T *res = out.data();
+        // the slot still holds the frame leaving the window once it is full
+        const T keep = (count < depth) ? T(0) : T(1);
+        const T scale = T(1) / T(std::min(count + 1, depth));
+        for(size_t i = 0; i < frame_size_; ++i)
+        {
+            acc[i] += frame[i] - keep * slot[i];
+            slot[i] = frame[i];
+            res[i] = acc[i] * scale;
+        }
+        oldest = (oldest + 1) % depth;
+        if(oldest == 0) resync_sum();
+    }
+
+    // Rebuilds the running sum once per window to cancel rounding drift,
+    // which amortizes to one extra add per sample and frame
+    void resync_sum()
+    {
+        const size_t n = std::min(count + 1, depth);
+        std::fill(sum.begin(), sum.end(), 0);
+        for(size_t f = 0; f < n; ++f)
+        {
+            const T *slot = history.data() + f * frame_size_;
+            for(size_t i = 0; i < frame_size_; ++i)
+                sum[i] += slot[i];
+        }
+    }
+
+    void push_exp_average(const T *frame)
+    {
+        T *res = out.data();
+        if(count == 0) {
+            std::copy(frame, frame + frame_size_, res);
+            return;
+        }
+        const T alpha = T(1) / T(depth);
+        for(size_t i = 0; i < frame_size_; ++i)
+            res[i] += (frame[i] - res[i]) * alpha;
+    }
+
+    void push_envelope(const T *frame)
+    {
+        T *mn = env_min.data();
+        T *mx = env_max.data();
+        T *res = out.data();
+        if(count == 0) {
+            std::copy(frame, frame + frame_size_, mn);
+            std::copy(frame, frame + frame_size_, mx);
+        }
+        const T decay = T(1) / T(depth);
+        for(size_t i = 0; i < frame_size_; ++i)
+        {
+            mn[i] = std::min(frame[i], mn[i] + (frame[i] - mn[i]) * decay);
+            mx[i] = std::max(frame[i], mx[i] + (frame[i] - mx[i]) * decay);
+            res[i] = (mn[i] + mx[i]) * T(0.5);
+        }
+    }
+
+    acquisition_mode mode = acquisition_mode::normal;
+    size_t frame_size_, max_depth_;
+    size_t depth = 16, count = 0, oldest = 0;
+    vector<T> history, sum, out, env_min, env_max;
+};
+
+// Finished frames handed from the acquisition thread to the display.
+// `sequence` grows by one per published frame, the display caches on it.
+template<typename T>
+struct acquisition_frame
+{
+    acquisition_mode mode = acquisition_mode::normal;
+    size_t sequence = 0;
+    vector<T> out, env_min, env_max;
+};
+
+// Acquisition side of the averaging modes, fed from the acquisition thread.
+// Frames start on a rising crossing of the trigger level, so a periodic signal
+// keeps its phase from one frame to the next and averages without smearing.
+// The level is the middle of the previous frame, with a hysteresis of a tenth of
+// its amplitude; without any crossing for two frames the capture starts anyway
+// (auto trigger), so flat or very slow signals are still shown.
+// Results are published through a triple buffer : the producer never waits, and
+// the display always reads the last complete frame.
+template<typename T>
+class triggered_acquisition
+{
+public:
+
+    triggered_acquisition(size_t frame_size, size_t max_depth = 64) :
+        averager(frame_size, max_depth), capture(frame_size, 0)
+    {
+        for(auto & it : results)
+        {
+            it.out.assign(frame_size, 0);
+            it.env_min.assign(frame_size, 0);
+            it.env_max.assign(frame_size, 0);
+        }
+    }
+
+    // Can be called from any thread, applied at the start of the next block
+    void set_mode(acquisition_mode m)
+    {
+        requested_mode.store(m, std::memory_order_release);
+    }
+
+    acquisition_mode get_mode() const
+    {
+        return requested_mode.load(std::memory_order_acquire);
+    }
+
+    // Called from the acquisition thread, once per block
+    void process(const T *data, size_t size)
+    {
+        const acquisition_mode m = requested_mode.load(std::memory_order_acquire);
+        if(m != averager.get_mode()) {
+            averager.set_mode(m);
+            fill = 0;
+            armed = false;
+            waited = 0;
+        }
+        if(m == acquisition_mode::normal) return;
+
+        const size_t frame_size = capture.size();
+        for(size_t i = 0; i < size; ++i)
+        {
+            const T v = data[i];
+            if(fill == 0) {
+                // waiting for the trigger
+                if(v < level - hysteresis) armed = true;
+                const bool crossing = armed && v >= level;
+                if(!crossing && ++waited < frame_size * 2) continue;
+                armed = false;
+                waited = 0;
+            }
+            capture[fill] = v;
+            if(++fill == frame_size) {
+                fill = 0;
+                finish_frame();
+            }
+        }
+    }
+
+    // Display thread only : the last published frame
+    const acquisition_frame<T> &latest()
+    {
+        if(middle.load(std::memory_order_relaxed) & fresh)
+            front = middle.exchange(front, std::memory_order_acq_rel) & index_mask;
+        return results[front];
+    }
+
+private:
+
+    constexpr static const unsigned fresh = 4, index_mask = 3;
+
+    void finish_frame()
+    {
+        averager.push(capture.data());
+        const auto range = std::minmax_element(capture.begin(), capture.end());
+        level = (*range.first + *range.second) * T(0.5);
+        hysteresis = (*range.second - *range.first) * T(0.1);
+
+        acquisition_frame<T> &r = results[back];
+        r.mode = averager.get_mode();
+        r.sequence = ++published;
+        std::copy(averager.output().begin(), averager.output().end(), r.out.begin());
+        if(r.mode == acquisition_mode::envelope) {
+            std::copy(averager.min_envelope().begin(), averager.min_envelope().end(), r.env_min.begin());
+            std::copy(averager.max_envelope().begin(), averager.max_envelope().end(), r.env_max.begin());
+        }
+        back = middle.exchange(back | fresh, std::memory_order_acq_rel) & index_mask;
+    }
+
+    frame_averager<T> averager;
+    vector<T> capture;
+    size_t fill = 0, waited = 0;
+    bool armed = false;
+    T level = 0, hysteresis = 0;
+    std::atomic<acquisition_mode> requested_mode {acquisition_mode::normal};
+
+    acquisition_frame<T> results[3];
+    unsigned back = 0, front = 1;
+    size_t published = 0;
+    std::atomic<unsigned> middle {2};
+};
+
+#endif // AVERAGING_H
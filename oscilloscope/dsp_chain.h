@@ -0,0 +1,253 @@
+/*=============================================================================
+   Copyright (c) 2021 Johann Philippe
+
+   Distributed under the MIT License (https://opensource.org/licenses/MIT)
+=============================================================================*/
+#ifndef DSP_CHAIN_H
+#define DSP_CHAIN_H
+
+#include<vector>
+#include<atomic>
+#include<math.h>
+
+using namespace std;
+
+enum class processor_type {
+    lowpass = 0,
+    highpass = 1,
+    bandpass = 2,
+    dc_blocker = 3,
+    gain = 4,
+    rectifier = 5
+};
+
+// Description of one stage, as edited by the user
+struct processor_desc
+{
+    processor_type type;
+    double frequency = 1000.0;
+    double q = 0.707;
+    double amount = 1.0; // gain factor, or DC blocker pole
+};
+
+// One processing stage working in place on interleaved blocks.
+// Filters are biquads in transposed direct form II, with one state per channel;
+// the channel loop is the innermost one so it vectorizes across channels.
+template<typename T>
+class processor
+{
+public:
+
+    processor(const processor_desc &d, double sample_rate, size_t channels) :
+        desc(d), rate(sample_rate), z1(channels, 0), z2(channels, 0)
+    {
+        if(is_filter()) make_biquad();
+    }
+
+    bool is_filter() const
+    {
+        return desc.type == processor_type::lowpass || desc.type == processor_type::highpass ||
+                desc.type == processor_type::bandpass;
+    }
+
+    // New cutoff or center frequency of a filter, the filter state is kept so
+    // the signal goes on without a click. Allocates nothing.
+    void set_frequency(double f)
+    {
+        if(!is_filter() || f == desc.frequency) return;
+        desc.frequency = f;
+        make_biquad();
+    }
+
+    void process(T *data, size_t frames)
+    {
+        const size_t channels = z1.size();
+        switch(desc.type)
+        {
+        case processor_type::lowpass:
+        case processor_type::highpass:
+        case processor_type::bandpass:
+            for(size_t f = 0; f < frames; ++f)
+            {
+                T *x = data + f * channels;
+                for(size_t c = 0; c < channels; ++c)
+                {
+                    const T in = x[c];
+                    const T out = b0 * in + z1[c];
+                    z1[c] = b1 * in - a1 * out + z2[c];
+                    z2[c] = b2 * in - a2 * out;
+                    x[c] = out;
+                }
+            }
+            break;
+        case processor_type::dc_blocker:
+        {
+            // y[n] = x[n] - x[n - 1] + R * y[n - 1], z1 holds x[n - 1] and z2 y[n - 1]
+            const T r = T(desc.amount);
+            for(size_t f = 0; f < frames; ++f)
+            {
+                T *x = data + f * channels;
+                for(size_t c = 0; c < channels; ++c)
+                {
+                    const T out = x[c] - z1[c] + r * z2[c];
+                    z1[c] = x[c];
+                    z2[c] = out;
+                    x[c] = out;
+                }
+            }
+            break;
+        }
+        case processor_type::gain:
+        {
+            const T g = T(desc.amount);
+            for(size_t i = 0; i < frames * channels; ++i)
+                data[i] *= g;
+            break;
+        }
+        case processor_type::rectifier:
+            for(size_t i = 0; i < frames * channels; ++i)
+                data[i] = std::abs(data[i]);
+            break;
+        }
+    }
+
+private:
+
+    // Coefficients from the RBJ audio EQ cookbook, normalized by a0
+    void make_biquad()
+    {
+        const double w0 = 2.0 * M_PI * desc.frequency / rate;
+        const double cw = cos(w0);
+        const double alpha = sin(w0) / (2.0 * desc.q);
+        double nb0, nb1, nb2;
+        switch(desc.type)
+        {
+        case processor_type::lowpass:
+            nb0 = (1.0 - cw) / 2.0; nb1 = 1.0 - cw; nb2 = nb0;
+            break;
+        case processor_type::highpass:
+            nb0 = (1.0 + cw) / 2.0; nb1 = -(1.0 + cw); nb2 = nb0;
+            break;
+        default: // constant 0 dB peak gain band pass
+            nb0 = alpha; nb1 = 0.0; nb2 = -alpha;
+            break;
+        }
+        const double a0 = 1.0 + alpha;
+        b0 = T(nb0 / a0); b1 = T(nb1 / a0); b2 = T(nb2 / a0);
+        a1 = T(-2.0 * cw / a0); a2 = T((1.0 - alpha) / a0);
+    }
+
+    processor_desc desc;
+    double rate;
+    T b0 = 1, b1 = 0, b2 = 0, a1 = 0, a2 = 0;
+    vector<T> z1, z2;
+};
+
+template<typename T>
+class dsp_chain
+{
+public:
+
+    dsp_chain(const vector<processor_desc> &descs, double sample_rate, size_t channels = 1) :
+        channels_(channels)
+    {
+        stages.reserve(descs.size());
+        for(auto & it : descs)
+            stages.emplace_back(it, sample_rate, channels);
+    }
+
+    void process(T *data, size_t frames)
+    {
+        for(auto & it : stages)
+            it.process(data, frames);
+    }
+
+    void set_frequency(double f)
+    {
+        for(auto & it : stages)
+            it.set_frequency(f);
+    }
+
+    size_t channels() const {return channels_;}
+
+private:
+    size_t channels_;
+    vector< processor<T> > stages;
+};
+
+// Hands chains built on the UI thread to the producer without ever blocking it.
+// The producer picks a pending chain at the start of a block, and parks the chain
+// it replaces in `retired` for the UI thread to delete. It only swaps when the
+// previous retired chain has been collected, so it never frees memory itself.
+// Without a chain, or when bypassed, process() is a single atomic load.
+// A new filter frequency goes through set_frequency() instead of a new chain :
+// the producer updates the coefficients of its chain in place, keeping the
+// filter state, so moving a cutoff does not click.
+template<typename T>
+class chain_exchange
+{
+public:
+
+    ~chain_exchange()
+    {
+        delete pending.exchange(nullptr);
+        delete retired.exchange(nullptr);
+        delete active;
+    }
+
+    // UI thread
+    void publish(dsp_chain<T> *chain)
+    {
+        collect();
+        delete pending.exchange(chain, std::memory_order_acq_rel);
+    }
+
+    // UI thread, deletes the chain the producer has released
+    void collect()
+    {
+        delete retired.exchange(nullptr, std::memory_order_acq_rel);
+    }
+
+    void set_bypass(bool b)
+    {
+        bypass.store(b, std::memory_order_relaxed);
+    }
+
+    // UI thread, applied by the producer at the start of its next block
+    void set_frequency(double f)
+    {
+        frequency.store(f, std::memory_order_relaxed);
+    }
+
+    // Producer thread, in place
+    void process(T *data, size_t frames)
+    {
+        if(pending.load(std::memory_order_relaxed) != nullptr &&
+                retired.load(std::memory_order_acquire) == nullptr)
+        {
+            dsp_chain<T> *next = pending.exchange(nullptr, std::memory_order_acq_rel);
+            if(next != nullptr) {
+                if(active != nullptr) retired.store(active, std::memory_order_release);
+                active = next;
+                applied_frequency = 0;
+            }
+        }
+        if(active == nullptr || bypass.load(std::memory_order_relaxed)) return;
+        const double f = frequency.load(std::memory_order_relaxed);
+        if(f > 0 && f != applied_frequency) {
+            active->set_frequency(f);
+            applied_frequency = f;
+        }
+        active->process(data, frames);
+    }
+
+private:
+    std::atomic<dsp_chain<T> *> pending {nullptr}, retired {nullptr};
+    std::atomic<bool> bypass {false};
+    // 0 until the first set_frequency()
+    std::atomic<double> frequency {0};
+    dsp_chain<T> *active = nullptr;
+    double applied_frequency = 0;
+};
+
+#endif // DSP_CHAIN_H
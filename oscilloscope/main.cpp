@@ -8,7 +8,10 @@
 #include"circular_buffer.h"
 #include<thread>
 #include"oscillator.h"
+#include"averaging.h"
+#include"reconstruction.h"
 #include<atomic>
+#include<iomanip>
 
 using namespace cycfi::elements;
 using namespace cycfi::artist;
@@ -126,7 +129,9 @@ public:
     oscilloscope() :
         tracker(), internal_buffer(vector_size, 0),
         freq(1.0), osc(sample_rate, vector_size, freq),
-        is_running(false), circular(circular_size, 0)
+        is_running(false), circular(circular_size, 0),
+        rec(vector_size, sample_rate), meter(sample_rate),
+        acquisition(circular_size), frame(circular_size, 0)
     {
     }
 
@@ -166,6 +171,7 @@ public:
     void draw_scope(const context &ctx)
     {
         if(!is_running) return;
+        osc.get_processing().collect();
 
         if(lock_sync) {
 
@@ -174,31 +180,155 @@ public:
             concurrent_queue<float>& cv = osc.get_buffer();
             float v = 0;
             while(cv.try_pop(v)) {
+                ++frame_version;
                 circular.set(v);
             }
 
+            const acquisition_frame<float> &acq = acquisition.latest();
+            const bool averaged = acquisition.get_mode() != acquisition_mode::normal &&
+                    acq.mode == acquisition.get_mode();
+            // the two version counters are unrelated, a cached trace of one
+            // source must not pass for the other
+            if(averaged != averaged_trace) recon.invalidate();
+            averaged_trace = averaged;
+            if(averaged) {
+                if(acq.mode == acquisition_mode::envelope) {
+                    draw_trace(ctx, acq.env_min, acq.sequence, colors::azure.opacity(0.4), false);
+                    draw_trace(ctx, acq.env_max, acq.sequence, colors::azure.opacity(0.4), false);
+                }
+                draw_trace(ctx, acq.out, acq.sequence, colors::azure, true);
+                return;
+            }
 
-            ctx.canvas.stroke_color(colors::azure);
-            ctx.canvas.line_width(2);
-            for(auto it = circular.init_read(); it < circular.size() - 1; it = circular.next())
-            {
-                float v = circular.get();
-                float vnext = circular.get_at(it + 1);
+            linearize();
+            draw_trace(ctx, frame, frame_version, colors::azure, true);
+        }
+    }
 
-                const float px2 = float(it + 1) / float(circular_size);
-                const point p2 = point(px2 * ctx.bounds.size().x + ctx.bounds.left,
-                                       ((vnext + 1) / 2.0) * ctx.bounds.size().y + ctx.bounds.top);
+    // Copies the display buffer, oldest sample first
+    void linearize()
+    {
+        circular.init_read();
+        for(int i = 0; i < circular_size; ++i)
+            frame[i] = circular.get_at(i);
+    }
 
-                if(it == 0) {
-                    const float px1 = float(it) / float(circular_size);
-                    const point p1 = point(px1 * ctx.bounds.size().x + ctx.bounds.left,
-                                       ((v + 1) / 2.0) * ctx.bounds.size().y + ctx.bounds.top);
-                    ctx.canvas.move_to(p1);
+    // Draws the visible window of `data`. When there are fewer samples than pixels
+    // and reconstruction is enabled, the band-limited signal is drawn instead of
+    // straight segments between samples. `version` changes whenever `data` does.
+    void draw_trace(const context &ctx, const vector<float> &data, size_t version, color c, bool reconstruct)
+    {
+        const size_t first = view_first;
+        const size_t count = std::min(view_count, data.size() - first);
+        const float width = ctx.bounds.width();
+        const size_t factor = std::min(recon.max_factor(), size_t(ceil(width / float(count))));
+
+        auto to_screen = [&](float pos, float v) {
+            return point((pos / float(count)) * width + ctx.bounds.left,
+                         ((v + 1) / 2.0) * ctx.bounds.size().y + ctx.bounds.top);
+        };
+
+        ctx.canvas.stroke_color(c);
+        ctx.canvas.line_width(2);
+        if(reconstruct && reconstruction && factor > 1) {
+            if(!recon.is_cached(version, first, count, factor)) {
+                // visible window with clamped context on both sides
+                const int half_taps = int(recon.half_taps());
+                padded.resize(count + half_taps * 2);
+                for(int i = 0; i < int(padded.size()); ++i)
+                {
+                    const int idx = std::clamp(int(first) + i - half_taps, 0, int(data.size()) - 1);
+                    padded[i] = data[idx];
                 }
-                ctx.canvas.line_to(p2);
+                recon.process(padded.data(), version, first, count, factor);
             }
-            ctx.canvas.stroke();
+            const vector<float> &out = recon.output();
+            ctx.canvas.move_to(to_screen(0, out[0]));
+            for(size_t i = 1; i < out.size(); ++i)
+                ctx.canvas.line_to(to_screen(float(i) / float(factor), out[i]));
+        } else {
+            ctx.canvas.move_to(to_screen(0, data[first]));
+            for(size_t i = 1; i < count; ++i)
+                ctx.canvas.line_to(to_screen(float(i), data[first + i]));
         }
+        ctx.canvas.stroke();
+    }
+
+    // Vertical scroll zooms around the cursor, horizontal scroll pans
+    bool scroll(context const &ctx, point dir, point p) override
+    {
+        const double rel = std::clamp((p.x - ctx.bounds.left) / ctx.bounds.width(), 0.0f, 1.0f);
+        const double anchor = double(view_first) + rel * double(view_count);
+        double count = double(view_count);
+        if(dir.y > 0) count /= 1.25;
+        else if(dir.y < 0) count *= 1.25;
+        count = std::clamp(count, double(min_view_count), double(circular_size));
+
+        double first = anchor - rel * count - dir.x * count / 20.0;
+        first = std::clamp(first, 0.0, double(circular_size) - count);
+        view_first = size_t(first);
+        view_count = size_t(count);
+        ctx.view.refresh();
+        return true;
+    }
+
+    // Presets : 0 is bypass, then the processor_type of the first stage
+    void set_processing(int preset)
+    {
+        processing_preset = preset;
+        rebuild_chain();
+    }
+
+    // Same chain with new coefficients : only a new preset builds a chain
+    void set_cutoff(double f)
+    {
+        cutoff = f;
+        osc.get_processing().set_frequency(f);
+    }
+
+    void rebuild_chain()
+    {
+        if(processing_preset == 0) {
+            osc.get_processing().set_bypass(true);
+            return;
+        }
+
+        vector<processor_desc> descs;
+        const processor_type type = processor_type(processing_preset - 1);
+        if(type == processor_type::rectifier) {
+            descs.push_back(processor_desc{processor_type::dc_blocker, 0, 0, 0.995});
+            descs.push_back(processor_desc{processor_type::rectifier});
+        } else {
+            descs.push_back(processor_desc{type, cutoff, 0.707});
+        }
+        osc.get_processing().publish(new dsp_chain<float>(descs, sample_rate));
+        osc.get_processing().set_bypass(false);
+    }
+
+    void set_reconstruction(bool b)
+    {
+        reconstruction = b;
+    }
+
+    void set_acquisition_mode(acquisition_mode m)
+    {
+        acquisition.set_mode(m);
+        recon.invalidate();
+    }
+
+    void draw_measures(const context &ctx)
+    {
+        if(!is_running) return;
+        const signal_measures m = meter.get();
+        std::ostringstream out;
+        out.precision(3);
+        out << std::fixed << "RMS " << m.rms << "   Vpp " << m.peak_to_peak
+            << "   DC " << m.dc << "   Freq " << std::setprecision(1) << m.frequency
+            << " Hz   Duty " << m.duty_cycle * 100.0f << " %";
+
+        ctx.canvas.fill_color(colors::ivory.opacity(0.8));
+        ctx.canvas.text_align(ctx.canvas.left | ctx.canvas.top);
+        ctx.canvas.fill_text(out.str(), point(ctx.bounds.left + 10, ctx.bounds.top + 10));
     }
 
     void draw(const context &ctx) override
@@ -208,6 +338,7 @@ public:
         ctx.canvas.fill();
         draw_grid(ctx);
         draw_scope(ctx);
+        draw_measures(ctx);
     }
 
     void set_frequency(double freq)
@@ -225,6 +356,8 @@ public:
         if(!is_running) {
             is_running = b;
             osc.set_waveform(waveform::sine);
+            osc.set_meter(&meter);
+            osc.set_acquisition(&acquisition);
             t = std::thread([&](){
                 int time_ms = 0;
                 int time_s = 0;
@@ -254,6 +387,28 @@ public:
        osc.set_pause(b);
     }
 
+    void record(bool b)
+    {
+        if(b) {
+            const auto stamp = std::chrono::system_clock::now().time_since_epoch();
+            const std::string path = "oscilloscope_" +
+                    std::to_string(std::chrono::duration_cast<std::chrono::seconds>(stamp).count()) + ".wav";
+            if(!rec.open(path, record_format::wav)) {
+                std::cout << "could not open " << path << std::endl;
+                return;
+            }
+            osc.set_recorder(&rec);
+            std::cout << "recording to " << path << std::endl;
+        } else if(rec.is_recording()) {
+            osc.set_recorder(nullptr);
+            rec.close();
+            std::cout << "recorded bytes : " << rec.bytes_written()
+                      << " dropped blocks : " << rec.dropped_blocks()
+                      << " dropped samples : " << rec.dropped_samples()
+                      << " max write latency (us) : " << rec.max_write_latency_us() << std::endl;
+        }
+    }
+
 private:
     vector<float> internal_buffer;
 
@@ -264,6 +419,20 @@ private:
     std::thread t;
     std::atomic<bool> is_running;
     circular_vector<float> circular;
+    recorder<float> rec;
+    signal_meter<float> meter;
+    triggered_acquisition<float> acquisition;
+    vector<float> frame;
+    size_t frame_version = 0;
+    bool averaged_trace = false;
+
+    constexpr static const size_t min_view_count = 16;
+    size_t view_first = 0, view_count = circular_size;
+    bool reconstruction = false;
+    int processing_preset = 0;
+    double cutoff = 1000.0;
+    sinc_reconstructor<float> recon;
+    vector<float> padded;
 
 };
 
@@ -322,6 +491,68 @@ int main(int argc, char* argv[])
 
    sine.select(true);
 
+   auto acq_normal = custom_radio_button("normal");
+   auto acq_average = custom_radio_button("average");
+   auto acq_exp_average = custom_radio_button("exp average");
+   auto acq_envelope = custom_radio_button("envelope");
+
+   acq_normal.on_click = [&](bool b) {
+       if(b) {
+           osc.set_acquisition_mode(acquisition_mode::normal);
+       }
+   };
+   acq_average.on_click = [&](bool b) {
+       if(b) {
+           osc.set_acquisition_mode(acquisition_mode::average);
+       }
+   };
+   acq_exp_average.on_click = [&](bool b) {
+       if(b) {
+           osc.set_acquisition_mode(acquisition_mode::exp_average);
+       }
+   };
+   acq_envelope.on_click = [&](bool b) {
+       if(b) {
+           osc.set_acquisition_mode(acquisition_mode::envelope);
+       }
+   };
+
+   acq_normal.select(true);
+
+   auto proc_bypass = custom_radio_button("bypass");
+   auto proc_lowpass = custom_radio_button("lowpass");
+   auto proc_highpass = custom_radio_button("highpass");
+   auto proc_bandpass = custom_radio_button("bandpass");
+   auto proc_rectify = custom_radio_button("rectify");
+
+   proc_bypass.on_click = [&](bool b) {
+       if(b) {
+           osc.set_processing(0);
+       }
+   };
+   proc_lowpass.on_click = [&](bool b) {
+       if(b) {
+           osc.set_processing(1 + int(processor_type::lowpass));
+       }
+   };
+   proc_highpass.on_click = [&](bool b) {
+       if(b) {
+           osc.set_processing(1 + int(processor_type::highpass));
+       }
+   };
+   proc_bandpass.on_click = [&](bool b) {
+       if(b) {
+           osc.set_processing(1 + int(processor_type::bandpass));
+       }
+   };
+   proc_rectify.on_click = [&](bool b) {
+       if(b) {
+           osc.set_processing(1 + int(processor_type::rectifier));
+       }
+   };
+
+   proc_bypass.select(true);
+
    auto freq = make_thumbwheel2(" Hz", 1.0, 499.0, 1, [&](double val) {
        osc.set_frequency(val);
    });
@@ -330,6 +561,10 @@ int main(int argc, char* argv[])
       osc.set_amp(val);
    });
 
+   auto cutoff = make_thumbwheel2(" Hz cutoff", 20.0, 4980.0, 0, [&](double val) {
+      osc.set_cutoff(val);
+   });
+
    auto tog = toggle_button("run", 1.0, colors::red);
    tog.select(false);
    tog.on_click = [&](bool b)
@@ -344,6 +579,20 @@ int main(int argc, char* argv[])
        osc.pause(b);
    };
 
+   auto record_toggle = toggle_button("record", 1.0, colors::orange);
+   record_toggle.select(false);
+   record_toggle.on_click = [&](bool b)
+   {
+       osc.record(b);
+   };
+
+   auto recon_toggle = toggle_button("reconstruct", 1.0, colors::light_steel_blue);
+   recon_toggle.select(false);
+   recon_toggle.on_click = [&](bool b)
+   {
+       osc.set_reconstruction(b);
+   };
+
    view_.post(fps, [&](){animate(view_);});
 
    view_.content(
@@ -354,9 +603,13 @@ int main(int argc, char* argv[])
                                     vtile(
                                         link(osc),
                                         top_margin(15, group("Waveform", top_margin(35, htile(sine, saw_up, saw_down, triangle, square)))),
-                                         hstretch(2, htile(freq,amp)),
+                                        top_margin(15, group("Acquisition", top_margin(35, htile(acq_normal, acq_average, acq_exp_average, acq_envelope)))),
+                                        top_margin(15, group("Processing", top_margin(35, htile(proc_bypass, proc_lowpass, proc_highpass, proc_bandpass, proc_rectify)))),
+                                         hstretch(2, htile(freq,amp,cutoff)),
                                         top_margin(15,tog),
-                                        top_margin(15, pause_toggle)
+                                        top_margin(15, pause_toggle),
+                                        top_margin(15, record_toggle),
+                                        top_margin(15, recon_toggle)
                                         )
                                     )
                            )
@@ -0,0 +1,217 @@
+/*=============================================================================
+   Copyright (c) 2021 Johann Philippe
+
+   Distributed under the MIT License (https://opensource.org/licenses/MIT)
+=============================================================================*/
+#ifndef MEASUREMENTS_H
+#define MEASUREMENTS_H
+
+#include<vector>
+#include<atomic>
+#include<algorithm>
+#include<math.h>
+
+using namespace std;
+
+struct signal_measures
+{
+    float rms = 0, peak_to_peak = 0, dc = 0, frequency = 0, duty_cycle = 0;
+};
+
+// Incremental measurements over a sliding window of the last `window_blocks` blocks.
+// Each incoming block is reduced once (sums, extrema, crossings), the window totals
+// are then updated by adding the new block and removing the oldest one, so the cost
+// per sample is constant whatever the window length.
+// The frequency is estimated from the rising crossings of the DC level, with hysteresis.
+// Results are published through a sequence lock : get() never blocks the producer.
+template<typename T>
+class signal_meter
+{
+public:
+
+    signal_meter(size_t sample_rate, size_t window_blocks = 8) :
+        sample_rate_(sample_rate), blocks(window_blocks)
+    {}
+
+    // Called from the acquisition thread, once per block
+    void process(const T *data, size_t size)
+    {
+        if(size == 0) return;
+        block_stats &st = blocks[current];
+        remove(st);
+        reduce(data, size, st);
+        find_crossings(data, size, st);
+        add(st);
+        current = (current + 1) % blocks.size();
+        sample_index += size;
+        update_measures();
+    }
+
+    // Lock free, can be called from any thread
+    signal_measures get() const
+    {
+        signal_measures m;
+        unsigned s1, s2;
+        do {
+            s1 = seq.load(std::memory_order_acquire);
+            m.rms = rms.load(std::memory_order_relaxed);
+            m.peak_to_peak = peak_to_peak.load(std::memory_order_relaxed);
+            m.dc = dc.load(std::memory_order_relaxed);
+            m.frequency = frequency.load(std::memory_order_relaxed);
+            m.duty_cycle = duty_cycle.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            s2 = seq.load(std::memory_order_relaxed);
+        } while((s1 & 1) || (s1 != s2));
+        return m;
+    }
+
+private:
+
+    struct block_stats
+    {
+        double sum = 0, sum_sq = 0;
+        float min = 0, max = 0;
+        size_t size = 0, above = 0, crossings = 0;
+        double first_crossing = 0, last_crossing = 0;
+    };
+
+    constexpr static const size_t lanes = 8;
+
+    // Independent lanes let the compiler vectorize the reductions
+    void reduce(const T *data, size_t size, block_stats &st)
+    {
+        float acc[lanes] = {0}, acc_sq[lanes] = {0};
+        float mn[lanes], mx[lanes];
+        size_t above[lanes] = {0};
+        std::fill(mn, mn + lanes, float(data[0]));
+        std::fill(mx, mx + lanes, float(data[0]));
+        const float thr = threshold;
+
+        const size_t vec_end = size - (size % lanes);
+        for(size_t i = 0; i < vec_end; i += lanes)
+        {
+            for(size_t l = 0; l < lanes; ++l)
+            {
+                const float v = data[i + l];
+                acc[l] += v;
+                acc_sq[l] += v * v;
+                mn[l] = std::min(mn[l], v);
+                mx[l] = std::max(mx[l], v);
+                above[l] += (v > thr);
+            }
+        }
+        for(size_t i = vec_end; i < size; ++i)
+        {
+            const float v = data[i];
+            acc[0] += v;
+            acc_sq[0] += v * v;
+            mn[0] = std::min(mn[0], v);
+            mx[0] = std::max(mx[0], v);
+            above[0] += (v > thr);
+        }
+
+        st = block_stats();
+        st.size = size;
+        st.min = mn[0];
+        st.max = mx[0];
+        for(size_t l = 0; l < lanes; ++l)
+        {
+            st.sum += acc[l];
+            st.sum_sq += acc_sq[l];
+            st.min = std::min(st.min, mn[l]);
+            st.max = std::max(st.max, mx[l]);
+            st.above += above[l];
+        }
+    }
+
+    void find_crossings(const T *data, size_t size, block_stats &st)
+    {
+        const float thr = threshold;
+        const float low = threshold - hysteresis;
+        for(size_t i = 0; i < size; ++i)
+        {
+            const float v = data[i];
+            if(armed) {
+                if(v >= thr) {
+                    const float frac = (v != previous) ? (thr - previous) / (v - previous) : 0.0f;
+                    const double t = double(sample_index + i) - 1.0 + frac;
+                    if(st.crossings == 0) st.first_crossing = t;
+                    st.last_crossing = t;
+                    st.crossings++;
+                    armed = false;
+                }
+            } else if(v < low) {
+                armed = true;
+            }
+            previous = v;
+        }
+    }
+
+    void add(const block_stats &st)
+    {
+        total_sum += st.sum;
+        total_sum_sq += st.sum_sq;
+        total_size += st.size;
+        total_above += st.above;
+    }
+
+    void remove(const block_stats &st)
+    {
+        total_sum -= st.sum;
+        total_sum_sq -= st.sum_sq;
+        total_size -= st.size;
+        total_above -= st.above;
+    }
+
+    void update_measures()
+    {
+        float mn = blocks[0].min, mx = blocks[0].max;
+        size_t crossings = 0;
+        double first = 0, last = 0;
+        // oldest to newest, the window is only a few blocks long
+        for(size_t b = 0; b < blocks.size(); ++b)
+        {
+            const block_stats &st = blocks[(current + b) % blocks.size()];
+            if(st.size == 0) continue;
+            mn = std::min(mn, st.min);
+            mx = std::max(mx, st.max);
+            if(st.crossings > 0) {
+                if(crossings == 0) first = st.first_crossing;
+                last = st.last_crossing;
+                crossings += st.crossings;
+            }
+        }
+
+        const double n = double(total_size);
+        const float mean = float(total_sum / n);
+        threshold = mean;
+        hysteresis = (mx - mn) * 0.05f;
+
+        seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        rms.store(float(sqrt(std::max(0.0, total_sum_sq / n))), std::memory_order_relaxed);
+        peak_to_peak.store(mx - mn, std::memory_order_relaxed);
+        dc.store(mean, std::memory_order_relaxed);
+        frequency.store((crossings > 1 && last > first) ?
+                            float(double(crossings - 1) * sample_rate_ / (last - first)) : 0.0f,
+                        std::memory_order_relaxed);
+        duty_cycle.store(float(double(total_above) / n), std::memory_order_relaxed);
+        seq.fetch_add(1, std::memory_order_release);
+    }
+
+    size_t sample_rate_;
+    vector<block_stats> blocks;
+    size_t current = 0;
+    size_t sample_index = 0;
+
+    double total_sum = 0, total_sum_sq = 0;
+    size_t total_size = 0, total_above = 0;
+
+    float threshold = 0, hysteresis = 0, previous = 0;
+    bool armed = false;
+
+    std::atomic<unsigned> seq {0};
+    std::atomic<float> rms {0}, peak_to_peak {0}, dc {0}, frequency {0}, duty_cycle {0};
+};
+
+#endif // MEASUREMENTS_H
@@ -7,6 +7,10 @@
 #define OSCILLATOR_H
 
 #include"concurrent_buffers.h"
+#include"recorder.h"
+#include"measurements.h"
+#include"dsp_chain.h"
+#include"averaging.h"
 #include<math.h>
 
     enum waveform {
@@ -27,7 +31,7 @@ public:
 
     oscillator(size_t sr, size_t vec_size, T frequency) :
         sample_rate(sr), vector_size(vec_size),
-        phasor(0), buffer(),
+        phasor(0), buffer(), block(vec_size, 0),
         frequency_(frequency), amp_(0.0), triangle_phase(0)
     {}
 
@@ -51,7 +55,7 @@ public:
     {
         for(int i = 0; i < vector_size; i++) {
             increment_phasor();
-            buffer.push( sin(M_PI * phasor * 2) * amp_);
+            block[i] = sin(M_PI * phasor * 2) * amp_;
         }
     }
 
@@ -59,7 +63,7 @@ public:
     {
         for(int i = 0; i < vector_size; i++) {
             increment_phasor();
-            buffer.push( ((phasor * 2.0) - 1.0) * amp_);
+            block[i] = ((phasor * 2.0) - 1.0) * amp_;
         }
 
     }
@@ -68,7 +72,7 @@ public:
     {
         for(int i = 0; i < vector_size; i++) {
             increment_phasor();
-            buffer.push( (((1.0 - phasor) * 2.0) - 1.0) * amp_);
+            block[i] = (((1.0 - phasor) * 2.0) - 1.0) * amp_;
         }
 
     }
@@ -77,7 +81,7 @@ public:
     {
         for(int i = 0; i < vector_size; i++) {
             increment_phasor();
-            buffer.push( (2 * (triangle_phase - 0.5)) * amp_);
+            block[i] = (2 * (triangle_phase - 0.5)) * amp_;
         }
     }
 
@@ -85,7 +89,7 @@ public:
     {
         for(int i = 0; i < vector_size; i++) {
             increment_phasor();
-            buffer.push( ((phasor < 0.5) ? -1.0 : 1.0) * amp_);
+            block[i] = ((phasor < 0.5) ? -1.0 : 1.0) * amp_;
         }
     }
 
@@ -114,6 +118,25 @@ public:
             get_square();
             break;
         }
+
+        processing.process(block.data(), block.size());
+
+        for(auto & it : block) buffer.push(it);
+
+        signal_meter<T> *m = meter_.load(std::memory_order_acquire);
+        if(m != nullptr) m->process(block.data(), block.size());
+
+        triggered_acquisition<T> *acq = acquisition_.load(std::memory_order_acquire);
+        if(acq != nullptr) acq->process(block.data(), block.size());
+
+        recorder<T> *rec = recorder_.load(std::memory_order_acquire);
+        if(rec != nullptr) rec->write(block.data(), block.size());
+    }
+
+    // Processing chain between the generator and every consumer of the block
+    chain_exchange<T>& get_processing()
+    {
+        return processing;
     }
 
     concurrent_queue<T>& get_buffer()
@@ -142,6 +165,22 @@ public:
         pause = b;
     }
 
+    // Measurement, acquisition and recording stages are fed from the thread calling update()
+    void set_meter(signal_meter<T> *m)
+    {
+        meter_.store(m, std::memory_order_release);
+    }
+
+    void set_acquisition(triggered_acquisition<T> *acq)
+    {
+        acquisition_.store(acq, std::memory_order_release);
+    }
+
+    void set_recorder(recorder<T> *rec)
+    {
+        recorder_.store(rec, std::memory_order_release);
+    }
+
 private:
     std::atomic<bool> pause = false;
     waveform waveform_ = sine;
@@ -149,6 +188,11 @@ private:
     T phasor, triangle_phase;
     bool up;
     concurrent_queue<T> buffer;
+    vector<T> block;
+    chain_exchange<T> processing;
+    std::atomic<recorder<T> *> recorder_ {nullptr};
+    std::atomic<signal_meter<T> *> meter_ {nullptr};
+    std::atomic<triggered_acquisition<T> *> acquisition_ {nullptr};
     T frequency_;
     double amp_;
 };
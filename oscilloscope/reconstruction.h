@@ -0,0 +1,109 @@
+/*=============================================================================
+   Copyright (c) 2021 Johann Philippe
+
+   Distributed under the MIT License (https://opensource.org/licenses/MIT)
+=============================================================================*/
+#ifndef RECONSTRUCTION_H
+#define RECONSTRUCTION_H
+
+#include<vector>
+#include<math.h>
+
+using namespace std;
+
+// Band-limited display reconstruction : windowed-sinc polyphase FIR upsampler.
+// One table of 2 * half_taps coefficients is precomputed per phase when the
+// upsampling factor changes, so each output point is a single dot product.
+// The output is cached with the key of the window it was computed from.
+template<typename T>
+class sinc_reconstructor
+{
+public:
+
+    sinc_reconstructor(size_t half_taps = 8, size_t max_factor = 32) :
+        half_taps_(half_taps), max_factor_(max_factor)
+    {}
+
+    size_t half_taps() const {return half_taps_;}
+    size_t max_factor() const {return max_factor_;}
+
+    bool is_cached(size_t version, size_t first, size_t count, size_t factor) const
+    {
+        return valid && version == key.version && first == key.first &&
+                count == key.count && factor == key.factor;
+    }
+
+    void invalidate() {valid = false;}
+
+    // `input` holds the `count` visible samples with `half_taps` samples of
+    // context on each side. Produces count * factor points, the i-th one
+    // being at position i / factor from the first visible sample.
+    const vector<T> &process(const T *input, size_t version, size_t first,
+                             size_t count, size_t factor)
+    {
+        if(factor != table_factor) make_table(factor);
+
+        const size_t taps = half_taps_ * 2;
+        out.resize(count * factor);
+        for(size_t n = 0; n < count; ++n)
+        {
+            // taps of phase p are applied to input[n + 1 .. n + taps]
+            const T *x = input + n + 1;
+            for(size_t p = 0; p < factor; ++p)
+            {
+                const T *h = table.data() + p * taps;
+                T acc = 0;
+                for(size_t k = 0; k < taps; ++k)
+                    acc += x[k] * h[k];
+                out[n * factor + p] = acc;
+            }
+        }
+
+        key = cache_key{version, first, count, factor};
+        valid = true;
+        return out;
+    }
+
+    const vector<T> &output() const {return out;}
+
+private:
+
+    void make_table(size_t factor)
+    {
+        const size_t taps = half_taps_ * 2;
+        table.resize(factor * taps);
+        for(size_t p = 0; p < factor; ++p)
+        {
+            const double frac = double(p) / double(factor);
+            double sum = 0;
+            for(size_t k = 0; k < taps; ++k)
+            {
+                // distance between the output point and input[n + 1 + k]
+                const double d = double(k) - double(half_taps_) + 1.0 - frac;
+                const double sinc = (d == 0.0) ? 1.0 : sin(M_PI * d) / (M_PI * d);
+                // Blackman window spanning [-half_taps, half_taps]
+                const double w = (d + double(half_taps_)) / double(taps);
+                const double blackman = 0.42 - 0.5 * cos(2.0 * M_PI * w) + 0.08 * cos(4.0 * M_PI * w);
+                table[p * taps + k] = T(sinc * blackman);
+                sum += sinc * blackman;
+            }
+            // unity gain at DC for every phase
+            for(size_t k = 0; k < taps; ++k)
+                table[p * taps + k] = T(table[p * taps + k] / sum);
+        }
+        table_factor = factor;
+    }
+
+    struct cache_key
+    {
+        size_t version, first, count, factor;
+    };
+
+    size_t half_taps_, max_factor_;
+    size_t table_factor = 0;
+    vector<T> table, out;
+    cache_key key {0, 0, 0, 0};
+    bool valid = false;
+};
+
+#endif // RECONSTRUCTION_H
@@ -0,0 +1,245 @@
+/*=============================================================================
+   Copyright (c) 2021 Johann Philippe
+
+   Distributed under the MIT License (https://opensource.org/licenses/MIT)
+=============================================================================*/
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include<vector>
+#include<string>
+#include<algorithm>
+#include<iostream>
+#include<memory.h>
+#include<atomic>
+#include<thread>
+#include<chrono>
+#include<cstdint>
+#include<cerrno>
+#include<fcntl.h>
+#include<unistd.h>
+
+using namespace std;
+
+enum record_format {
+    wav = 0,
+    raw = 1
+};
+
+// Capture-to-disk stage for the acquisition stream.
+// The acquisition thread copies its blocks into a small ring of preallocated
+// slots (two by default, i.e. a double buffer) and never waits : if the writer
+// thread has not released a slot yet, the samples are dropped and counted.
+// write() signals nothing : the writer thread polls the head every quarter of
+// a block duration, which leaves it three quarters of a block to write a slot.
+// The fill position and the head belong to write() : open() and close() only
+// touch them once no write() is in flight.
+// Samples are written as 32 bits float, either raw or inside a WAV container.
+template<typename T>
+class recorder
+{
+public:
+
+    recorder(size_t block_size, size_t sample_rate, size_t n_slots = 2) :
+        block_size_(block_size), sample_rate_(sample_rate),
+        slots(n_slots, vector<float>(block_size, 0.0f)),
+        slot_sizes(n_slots, block_size),
+        poll_interval(std::max(size_t(1), block_size * 1000000 / sample_rate / 4))
+    {}
+
+    ~recorder()
+    {
+        close();
+    }
+
+    bool open(const string &path, record_format fmt)
+    {
+        close();
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) return false;
+
+        format = fmt;
+        head = 0;
+        tail = 0;
+        fill_pos = 0;
+        bytes_written_ = 0;
+        dropped_samples_ = 0;
+        dropped_blocks_ = 0;
+        max_write_latency_us_ = 0;
+        file_offset = (format == record_format::wav) ? wav_header_size : 0;
+        if(format == record_format::wav) write_wav_header(0);
+
+        running = true;
+        writer = std::thread([this](){ writer_loop(); });
+        recording = true;
+        return true;
+    }
+
+    void close()
+    {
+        if(!running) return;
+        recording = false;
+        wait_writers();
+        // hand the partly filled slot to the writer with its real length
+        if(fill_pos > 0) {
+            const size_t h = head.load(std::memory_order_relaxed);
+            slot_sizes[h % slots.size()] = fill_pos;
+            fill_pos = 0;
+            head.store(h + 1, std::memory_order_release);
+        }
+        running = false;
+        if(writer.joinable()) writer.join();
+        if(format == record_format::wav) write_wav_header(file_offset - wav_header_size);
+        ::close(fd);
+        fd = -1;
+    }
+
+    // Called from the acquisition thread : copies only, never blocks on disk
+    void write(const T *data, size_t size)
+    {
+        // announce before checking, so that close() either sees this call or stops it
+        writers.fetch_add(1);
+        if(!recording.load()) {
+            writers.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+        for(size_t i = 0; i < size; ++i) {
+            if(fill_pos == 0 && !acquire_slot()) {
+                // no free slot, drop what is left of this block
+                dropped_samples_.fetch_add(size - i, std::memory_order_relaxed);
+                dropped_blocks_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            const size_t h = head.load(std::memory_order_relaxed);
+            slots[h % slots.size()][fill_pos] = float(data[i]);
+            if(++fill_pos == block_size_) {
+                slot_sizes[h % slots.size()] = block_size_;
+                fill_pos = 0;
+                head.store(h + 1, std::memory_order_release);
+            }
+        }
+        writers.fetch_sub(1, std::memory_order_release);
+    }
+
+    bool is_recording() const {return recording;}
+    size_t bytes_written() const {return bytes_written_;}
+    size_t dropped_samples() const {return dropped_samples_;}
+    // acquisition blocks that lost samples, and slots that failed to write
+    size_t dropped_blocks() const {return dropped_blocks_;}
+    size_t max_write_latency_us() const {return max_write_latency_us_;}
+
+private:
+
+    constexpr static const size_t wav_header_size = 44;
+
+    // Waits for the write() calls that passed the recording check
+    void wait_writers()
+    {
+        while(writers.load(std::memory_order_acquire) != 0)
+            std::this_thread::yield();
+    }
+
+    bool acquire_slot()
+    {
+        return (head.load(std::memory_order_relaxed) -
+                tail.load(std::memory_order_acquire)) < slots.size();
+    }
+
+    void writer_loop()
+    {
+        for(;;) {
+            const size_t h = head.load(std::memory_order_acquire);
+            size_t t = tail.load(std::memory_order_relaxed);
+            if(t == h) {
+                // running is cleared after the last head update, check the head again
+                if(!running) {
+                    if(head.load(std::memory_order_acquire) == t) break;
+                    continue;
+                }
+                std::this_thread::sleep_for(poll_interval);
+                continue;
+            }
+            for(; t != h; ++t) {
+                write_slot(slots[t % slots.size()], slot_sizes[t % slots.size()]);
+                tail.store(t + 1, std::memory_order_release);
+            }
+        }
+    }
+
+    // Writes the first `size` samples of a slot, retrying short writes.
+    // On failure the samples left are counted as dropped.
+    void write_slot(const vector<float> &slot, size_t size)
+    {
+        const uint8_t *data = reinterpret_cast<const uint8_t *>(slot.data());
+        size_t bytes = size * sizeof(float);
+        auto t1 = std::chrono::steady_clock::now();
+        while(bytes > 0)
+        {
+            const ssize_t res = ::pwrite(fd, data, bytes, off_t(file_offset));
+            if(res <= 0) {
+                if(res < 0 && errno == EINTR) continue;
+                cerr << "recorder : write failed" << endl;
+                dropped_samples_.fetch_add((bytes + sizeof(float) - 1) / sizeof(float), std::memory_order_relaxed);
+                dropped_blocks_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            data += res;
+            bytes -= size_t(res);
+            file_offset += size_t(res);
+            bytes_written_.fetch_add(size_t(res), std::memory_order_relaxed);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        const size_t latency = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+        if(latency > max_write_latency_us_) max_write_latency_us_ = latency;
+    }
+
+    static void put_u32(uint8_t *p, uint32_t v)
+    {
+        p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; p[2] = (v >> 16) & 0xff; p[3] = (v >> 24) & 0xff;
+    }
+
+    static void put_u16(uint8_t *p, uint16_t v)
+    {
+        p[0] = v & 0xff; p[1] = (v >> 8) & 0xff;
+    }
+
+    // Mono 32 bits float WAV header, rewritten with the real size on close
+    void write_wav_header(size_t data_size)
+    {
+        uint8_t hdr[wav_header_size];
+        ::memcpy(hdr, "RIFF", 4);
+        put_u32(hdr + 4, uint32_t(36 + data_size));
+        ::memcpy(hdr + 8, "WAVEfmt ", 8);
+        put_u32(hdr + 16, 16);
+        put_u16(hdr + 20, 3); // IEEE float
+        put_u16(hdr + 22, 1);
+        put_u32(hdr + 24, uint32_t(sample_rate_));
+        put_u32(hdr + 28, uint32_t(sample_rate_ * sizeof(float)));
+        put_u16(hdr + 32, sizeof(float));
+        put_u16(hdr + 34, 32);
+        ::memcpy(hdr + 36, "data", 4);
+        put_u32(hdr + 40, uint32_t(data_size));
+        if(::pwrite(fd, hdr, wav_header_size, 0) != ssize_t(wav_header_size))
+            cerr << "recorder : could not write WAV header" << endl;
+    }
+
+    size_t block_size_, sample_rate_;
+    vector< vector<float> > slots;
+    vector<size_t> slot_sizes;
+    size_t fill_pos = 0;
+    std::atomic<size_t> head {0}, tail {0};
+    std::atomic<size_t> writers {0};
+
+    std::atomic<bool> recording {false}, running {false};
+    std::thread writer;
+    std::chrono::microseconds poll_interval;
+
+    int fd = -1;
+    record_format format = record_format::wav;
+    size_t file_offset = 0;
+
+    std::atomic<size_t> bytes_written_ {0}, dropped_samples_ {0}, dropped_blocks_ {0},
+                        max_write_latency_us_ {0};
+};
+
+#endif // RECORDER_H